@@ -0,0 +1,627 @@
+#include "EigenFaces.h"
+#include "Log.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <opencv2/core/internal.hpp>
+
+// MSVC doesn't define __FMA__, but /arch:AVX2 enables FMA as well.
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define EIGEN_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+// Projection works through the pixels in blocks of this many, so the block of each face
+// in the group stays in cache while every basis row streams past it once. For the int16
+// basis this also bounds the int32 sums: each lane adds up 256 products of at most
+// 255 * EIGEN_QUANT_MAX, which stays below 2^31.
+static const int EIGEN_BLOCK = 2048;
+// Largest quantized basis value.
+static const int EIGEN_QUANT_MAX = 16383;
+
+// Training splits the faces into blocks of this many rows, or of this many pixel columns
+// where it goes down the faces (a column block of every face stays in cache).
+static const int EIGEN_TRAIN_ROWS = 32;
+static const int EIGEN_TRAIN_COLUMNS = 256;
+// Components the randomized SVD looks for first, how many more it samples than it keeps,
+// and how often it refines them with power iterations.
+static const int EIGEN_SEARCH_START = 32;
+static const int EIGEN_OVERSAMPLE = 10;
+static const int EIGEN_POWER_STEPS = 2;
+// Directions whose squared length is this small relative to the longest are dropped as noise.
+static const double EIGEN_RANK_EPSILON = 1e-10;
+
+CV_INIT_ALGORITHM(EigenFaceModel, "FaceRecognizer.EigenfacesFast",
+	obj.info()->addParam(obj, "retainedVariance", obj.retainedVariance);
+	obj.info()->addParam(obj, "maxComponents", obj.maxComponents);
+	obj.info()->addParam(obj, "quantize", obj.quantize));
+
+static int padded(int count)
+{
+	return (count + EIGEN_PAD - 1) / EIGEN_PAD * EIGEN_PAD;
+}
+
+#ifdef EIGEN_AVX2
+static inline float sum8(__m256 v)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+static inline long long sum8(__m256i v)
+{
+	// Widen first, eight lanes together can overflow int32.
+	__m256i wide = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)),
+		_mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+	long long lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, wide);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+// sums[f] += dot(basis, faces[f]) over [begin, end), for EIGEN_BATCH faces.
+static void dotBlock(const float *basis, const float *const *faces, int begin, int end, double *sums)
+{
+#ifdef EIGEN_AVX2
+	__m256 a0 = _mm256_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+	__m256 b0 = a0, b1 = a0, b2 = a0, b3 = a0;
+	for (int i = begin; i < end; i += 16) {
+		__m256 w = _mm256_load_ps(basis + i);
+		__m256 v = _mm256_load_ps(basis + i + 8);
+		a0 = _mm256_fmadd_ps(w, _mm256_load_ps(faces[0] + i), a0);
+		a1 = _mm256_fmadd_ps(w, _mm256_load_ps(faces[1] + i), a1);
+		a2 = _mm256_fmadd_ps(w, _mm256_load_ps(faces[2] + i), a2);
+		a3 = _mm256_fmadd_ps(w, _mm256_load_ps(faces[3] + i), a3);
+		b0 = _mm256_fmadd_ps(v, _mm256_load_ps(faces[0] + i + 8), b0);
+		b1 = _mm256_fmadd_ps(v, _mm256_load_ps(faces[1] + i + 8), b1);
+		b2 = _mm256_fmadd_ps(v, _mm256_load_ps(faces[2] + i + 8), b2);
+		b3 = _mm256_fmadd_ps(v, _mm256_load_ps(faces[3] + i + 8), b3);
+	}
+	sums[0] += sum8(_mm256_add_ps(a0, b0));
+	sums[1] += sum8(_mm256_add_ps(a1, b1));
+	sums[2] += sum8(_mm256_add_ps(a2, b2));
+	sums[3] += sum8(_mm256_add_ps(a3, b3));
+#else
+	float a[EIGEN_BATCH] = {};
+	for (int i = begin; i < end; i++) {
+		float w = basis[i];
+		for (int f = 0; f < EIGEN_BATCH; f++)
+			a[f] += w * faces[f][i];
+	}
+	for (int f = 0; f < EIGEN_BATCH; f++)
+		sums[f] += a[f];
+#endif
+}
+
+// Same for the int16 basis, end - begin must not exceed EIGEN_BLOCK.
+static void dotBlock(const short *basis, const short *const *faces, int begin, int end, double *sums)
+{
+#ifdef EIGEN_AVX2
+	__m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+	for (int i = begin; i < end; i += 16) {
+		__m256i w = _mm256_load_si256((const __m256i *)(basis + i));
+		a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(w, _mm256_load_si256((const __m256i *)(faces[0] + i))));
+		a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(w, _mm256_load_si256((const __m256i *)(faces[1] + i))));
+		a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(w, _mm256_load_si256((const __m256i *)(faces[2] + i))));
+		a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(w, _mm256_load_si256((const __m256i *)(faces[3] + i))));
+	}
+	sums[0] += (double)sum8(a0);
+	sums[1] += (double)sum8(a1);
+	sums[2] += (double)sum8(a2);
+	sums[3] += (double)sum8(a3);
+#else
+	long long a[EIGEN_BATCH] = {};
+	for (int i = begin; i < end; i++) {
+		int w = basis[i];
+		for (int f = 0; f < EIGEN_BATCH; f++)
+			a[f] += w * faces[f][i];
+	}
+	for (int f = 0; f < EIGEN_BATCH; f++)
+		sums[f] += (double)a[f];
+#endif
+}
+
+// Squared distance between two projections of length count (a multiple of EIGEN_PAD).
+static float distance2(const float *a, const float *b, int count)
+{
+#ifdef EIGEN_AVX2
+	__m256 s0 = _mm256_setzero_ps(), s1 = s0;
+	for (int i = 0; i < count; i += 16) {
+		__m256 d0 = _mm256_sub_ps(_mm256_load_ps(a + i), _mm256_load_ps(b + i));
+		__m256 d1 = _mm256_sub_ps(_mm256_load_ps(a + i + 8), _mm256_load_ps(b + i + 8));
+		s0 = _mm256_fmadd_ps(d0, d0, s0);
+		s1 = _mm256_fmadd_ps(d1, d1, s1);
+	}
+	return sum8(_mm256_add_ps(s0, s1));
+#else
+	float s = 0;
+	for (int i = 0; i < count; i++) {
+		float d = a[i] - b[i];
+		s += d * d;
+	}
+	return s;
+#endif
+}
+
+EigenFaceModel::EigenFaceModel(double retainedVariance, int maxComponents, bool quantize)
+	: retainedVariance(retainedVariance), maxComponents(maxComponents), quantize(quantize),
+	dim(0), dimPad(0), k(0), kPad(0), n(0)
+{
+}
+
+void EigenFaceModel::build()
+{
+	dim = basis.cols;
+	dimPad = padded(dim);
+	k = basis.rows;
+	kPad = padded(k);
+
+	basisF.resize((size_t)k * dimPad);
+	meanProj.assign(k, 0);
+	scaleQ.assign(k, 1);
+	if (quantize)
+		basisQ.resize((size_t)k * dimPad);
+
+	const float *m = mean.ptr<float>();
+	for (int j = 0; j < k; j++) {
+		const float *row = basis.ptr<float>(j);
+		float *out = basisF.get() + (size_t)j * dimPad;
+		std::copy(row, row + dim, out);
+
+		double dot = 0;
+		if (quantize) {
+			// Per-component scale, so every row uses the full int16 range it's allowed.
+			float largest = 0;
+			for (int i = 0; i < dim; i++)
+				largest = max(largest, (float)fabs(row[i]));
+			float scale = largest > 0 ? largest / EIGEN_QUANT_MAX : 1;
+			short *q = basisQ.get() + (size_t)j * dimPad;
+			for (int i = 0; i < dim; i++) {
+				q[i] = (short)cvRound(row[i] / scale);
+				dot += (double)m[i] * q[i];
+			}
+			scaleQ[j] = scale;
+			dot *= scale;
+		}
+		else {
+			for (int i = 0; i < dim; i++)
+				dot += (double)m[i] * row[i];
+		}
+		// dot(face - mean, w) = dot(face, w) - dot(mean, w), so faces never need
+		// the mean subtracted.
+		meanProj[j] = (float)dot;
+	}
+}
+
+void EigenFaceModel::projectGroup(const Mat &faces, float *out) const
+{
+	// Per thread, the frame loop predicts on the pool's threads concurrently.
+	static thread_local AlignedArray<float> floatFaces;
+	static thread_local AlignedArray<short> shortFaces;
+
+	int count = faces.rows;
+	const float *floatPtrs[EIGEN_BATCH];
+	const short *shortPtrs[EIGEN_BATCH];
+	if (quantize) {
+		if (shortFaces.size() < (size_t)EIGEN_BATCH * dimPad)
+			shortFaces.resize((size_t)EIGEN_BATCH * dimPad);
+		for (int f = 0; f < count; f++) {
+			short *dst = shortFaces.get() + (size_t)f * dimPad;
+			const uchar *src = faces.ptr<uchar>(f);
+			for (int i = 0; i < dim; i++)
+				dst[i] = src[i];
+			std::fill(dst + dim, dst + dimPad, 0);
+		}
+		// Short groups repeat the last face, its extra results are ignored.
+		for (int f = 0; f < EIGEN_BATCH; f++)
+			shortPtrs[f] = shortFaces.get() + (size_t)min(f, count - 1) * dimPad;
+	}
+	else {
+		if (floatFaces.size() < (size_t)EIGEN_BATCH * dimPad)
+			floatFaces.resize((size_t)EIGEN_BATCH * dimPad);
+		for (int f = 0; f < count; f++) {
+			float *dst = floatFaces.get() + (size_t)f * dimPad;
+			const uchar *src = faces.ptr<uchar>(f);
+			for (int i = 0; i < dim; i++)
+				dst[i] = src[i];
+			std::fill(dst + dim, dst + dimPad, 0.0f);
+		}
+		for (int f = 0; f < EIGEN_BATCH; f++)
+			floatPtrs[f] = floatFaces.get() + (size_t)min(f, count - 1) * dimPad;
+	}
+
+	vector<double> sums((size_t)k * EIGEN_BATCH, 0.0);
+	for (int begin = 0; begin < dimPad; begin += EIGEN_BLOCK) {
+		int end = min(begin + EIGEN_BLOCK, dimPad);
+		for (int j = 0; j < k; j++) {
+			if (quantize)
+				dotBlock(basisQ.get() + (size_t)j * dimPad, shortPtrs, begin, end, &sums[j * EIGEN_BATCH]);
+			else
+				dotBlock(basisF.get() + (size_t)j * dimPad, floatPtrs, begin, end, &sums[j * EIGEN_BATCH]);
+		}
+	}
+	for (int f = 0; f < count; f++) {
+		float *p = out + (size_t)f * kPad;
+		for (int j = 0; j < k; j++)
+			p[j] = (float)(sums[j * EIGEN_BATCH + f] * scaleQ[j]) - meanProj[j];
+		std::fill(p + k, p + kPad, 0.0f);
+	}
+}
+
+void EigenFaceModel::nearest(const float *projection, int &label, double &distance) const
+{
+	float best = FLT_MAX;
+	label = -1;
+	for (int i = 0; i < n; i++) {
+		float d = distance2(projection, projections.get() + (size_t)i * kPad, kPad);
+		if (d < best) {
+			best = d;
+			label = labels[i];
+		}
+	}
+	distance = label == -1 ? DBL_MAX : sqrt((double)best);
+}
+
+// out = a * x, blocks of rows of a in parallel.
+static void product(ThreadPool &pool, const Mat &a, const Mat &x, Mat &out)
+{
+	out.create(a.rows, x.cols, a.type());
+	int blocks = (a.rows + EIGEN_TRAIN_ROWS - 1) / EIGEN_TRAIN_ROWS;
+	pool.parallelFor(0, blocks, [&](int b) {
+		Range rows(b * EIGEN_TRAIN_ROWS, min(a.rows, (b + 1) * EIGEN_TRAIN_ROWS));
+		Mat dst = out.rowRange(rows);
+		gemm(a.rowRange(rows), x, 1, Mat(), 0, dst);
+	});
+}
+
+// out = a' * x, blocks of columns of a in parallel.
+static void productTransposed(ThreadPool &pool, const Mat &a, const Mat &x, Mat &out)
+{
+	out.create(a.cols, x.cols, a.type());
+	int blocks = (a.cols + EIGEN_TRAIN_COLUMNS - 1) / EIGEN_TRAIN_COLUMNS;
+	pool.parallelFor(0, blocks, [&](int b) {
+		Range columns(b * EIGEN_TRAIN_COLUMNS, min(a.cols, (b + 1) * EIGEN_TRAIN_COLUMNS));
+		Mat dst = out.rowRange(columns);
+		gemm(a.colRange(columns), x, 1, Mat(), 0, dst, GEMM_1_T);
+	});
+}
+
+// Eigenvalues (descending) and eigenvectors (rows) of a' * a, computed in double.
+// Returns how many are above noise.
+static int gramEigen(ThreadPool &pool, const Mat &a, Mat &values, Mat &vectors)
+{
+	Mat a64, gram;
+	a.convertTo(a64, CV_64F);
+	productTransposed(pool, a64, a64, gram);
+	eigen(gram, values, vectors);
+	int rank = 0;
+	while (rank < values.rows && values.at<double>(rank) > values.at<double>(0) * EIGEN_RANK_EPSILON)
+		rank++;
+	if (rank == 0)
+		CV_Error(CV_StsBadArg, "The training faces are all the same, there is nothing to learn.");
+	return rank;
+}
+
+// Replaces the columns of y by orthonormal ones spanning the same space, by whitening:
+// with y'y = V S V', y V S^-1/2 has orthonormal columns. Done twice to clean up the
+// rounding of the first pass. Dependent columns (tiny eigenvalues) are dropped.
+static void orthonormalize(ThreadPool &pool, Mat &y)
+{
+	for (int pass = 0; pass < 2; pass++) {
+		Mat values, vectors;
+		int rank = gramEigen(pool, y, values, vectors);
+		Mat whiten(y.cols, rank, CV_32F);
+		for (int j = 0; j < rank; j++) {
+			Mat column = whiten.col(j);
+			Mat(vectors.row(j).t() / sqrt(values.at<double>(j))).convertTo(column, CV_32F);
+		}
+		Mat q;
+		product(pool, y, whiten, q);
+		y = q;
+	}
+}
+
+// The largest singular values (squared, descending, CV_64F column) and right singular
+// vectors (rows) of data, found in sampled random directions (Halko et al.'s randomized
+// SVD). data is count x pixels, but only ever multiplied with count or pixels x sampled
+// matrices, nothing count x count or pixels x pixels is formed.
+static void decompose(ThreadPool &pool, const Mat &data, int sampled, TrainProgress &progress, Mat &values, Mat &vectors)
+{
+	// Seeded, so training the same faces gives the same model.
+	RNG rng(0x5eed);
+	Mat omega(data.cols, sampled, CV_32F);
+	rng.fill(omega, RNG::NORMAL, Scalar(0), Scalar(1));
+
+	// y spans the directions data stretches most, power iterations sharpen it.
+	Mat y, z;
+	product(pool, data, omega, y);
+	orthonormalize(pool, y);
+	progress.advance();
+	for (int step = 0; step < EIGEN_POWER_STEPS; step++) {
+		productTransposed(pool, data, y, z);
+		orthonormalize(pool, z);
+		product(pool, data, z, y);
+		orthonormalize(pool, y);
+		progress.advance();
+	}
+
+	// data ~ y * (y' * data), so the SVD of the small y' * data is the one of data.
+	// z = (y' * data)' and its Gram matrix have the singular values squared and the
+	// directions they belong to.
+	productTransposed(pool, data, y, z);
+	Mat gramValues, gramVectors;
+	int rank = gramEigen(pool, z, gramValues, gramVectors);
+	Mat directions;
+	gramVectors.rowRange(0, rank).t().convertTo(directions, CV_32F);
+	Mat right;
+	product(pool, z, directions, right);
+	vectors = right.t();
+	values.create(rank, 1, CV_64F);
+	for (int j = 0; j < rank; j++) {
+		Mat row = vectors.row(j);
+		double length = norm(row);
+		values.at<double>(j) = length * length;
+		row *= 1.0 / length;
+	}
+	progress.advance();
+}
+
+void EigenFaceModel::train(InputArrayOfArrays _src, InputArray _labels)
+{
+	TrainProgress progress;
+	train(_src, _labels, ThreadPool::shared(), progress);
+}
+
+void EigenFaceModel::train(InputArrayOfArrays _src, InputArray _labels, ThreadPool &pool, TrainProgress &progress)
+{
+	vector<Mat> src;
+	_src.getMatVector(src);
+	Mat labelMat = _labels.getMat();
+	if (src.empty())
+		CV_Error(CV_StsBadArg, "Empty training data was given. You'll need more than one sample to learn a model.");
+	if ((int)labelMat.total() != (int)src.size())
+		CV_Error(CV_StsBadArg, "The number of samples must equal the number of labels.");
+	int count = (int)src.size();
+	int pixels = (int)src[0].total();
+	for (int i = 0; i < count; i++) {
+		if ((int)src[i].total() != pixels)
+			CV_Error(CV_StsBadArg, "All training images must have the same size.");
+	}
+	if (count < 2)
+		CV_Error(CV_StsBadArg, "At least two faces are needed to learn a model.");
+
+	// One face per row, as bytes for the projection kernels and centered as floats for the
+	// decomposition. Rows are copied in blocks, then the mean is taken over blocks of columns
+	// of all faces, which are centered while the block is still in cache.
+	int rowBlocks = (count + EIGEN_TRAIN_ROWS - 1) / EIGEN_TRAIN_ROWS;
+	int columnBlocks = (pixels + EIGEN_TRAIN_COLUMNS - 1) / EIGEN_TRAIN_COLUMNS;
+	progress.start("data matrix", rowBlocks + columnBlocks);
+	Mat faces(count, pixels, CV_8UC1);
+	pool.parallelFor(0, rowBlocks, [&](int b) {
+		for (int i = b * EIGEN_TRAIN_ROWS; i < min(count, (b + 1) * EIGEN_TRAIN_ROWS); i++) {
+			Mat row = faces.row(i);
+			src[i].reshape(1, 1).convertTo(row, CV_8U); // row is the right size, so this fills faces
+		}
+		progress.advance();
+	});
+	Mat data(count, pixels, CV_32F);
+	mean.create(1, pixels, CV_32F);
+	vector<double> squares(columnBlocks, 0.0);
+	pool.parallelFor(0, columnBlocks, [&](int b) {
+		int begin = b * EIGEN_TRAIN_COLUMNS;
+		int end = min(pixels, begin + EIGEN_TRAIN_COLUMNS);
+		vector<double> sums(end - begin, 0.0);
+		for (int i = 0; i < count; i++) {
+			const uchar *row = faces.ptr<uchar>(i);
+			for (int c = begin; c < end; c++)
+				sums[c - begin] += row[c];
+		}
+		float *m = mean.ptr<float>();
+		for (int c = begin; c < end; c++)
+			m[c] = (float)(sums[c - begin] / count);
+		double squared = 0;
+		for (int i = 0; i < count; i++) {
+			const uchar *row = faces.ptr<uchar>(i);
+			float *out = data.ptr<float>(i);
+			for (int c = begin; c < end; c++) {
+				out[c] = row[c] - m[c];
+				squared += (double)out[c] * out[c];
+			}
+		}
+		squares[b] = squared;
+		progress.advance();
+	});
+	// Total variance, what retainedVariance is a part of.
+	double total = 0;
+	for (int b = 0; b < columnBlocks; b++)
+		total += squares[b];
+
+	// Only the components needed for retainedVariance, the rest are mostly noise and
+	// cost a full pass over the face each. If the ones sampled don't explain enough of
+	// the variance, twice as many are sampled. Centered faces span count - 1 directions.
+	int limit = min(count - 1, pixels);
+	int wanted = min(maxComponents > 0 ? maxComponents : EIGEN_SEARCH_START, limit);
+	Mat values, vectors;
+	int kept;
+	while (true) {
+		int sampled = min(wanted + EIGEN_OVERSAMPLE, limit);
+		progress.start("components", EIGEN_POWER_STEPS + 2);
+		decompose(pool, data, sampled, progress, values, vectors);
+		double captured = 0;
+		kept = 0;
+		while (kept < values.rows && captured < retainedVariance * total)
+			captured += values.at<double>(kept++);
+		if (maxComponents > 0) {
+			kept = min(kept, maxComponents);
+			break;
+		}
+		// The oversampled ones are less accurate, they don't count.
+		if ((captured >= retainedVariance * total && kept <= wanted) || sampled == limit)
+			break;
+		wanted = min(wanted * 2, limit);
+	}
+	vectors.rowRange(0, kept).copyTo(basis);
+	build();
+
+	n = count;
+	labels.resize(n);
+	for (int i = 0; i < n; i++)
+		labels[i] = labelMat.at<int>(i);
+	// Training faces go through the same kernels as the faces they're compared with.
+	int groups = (n + EIGEN_BATCH - 1) / EIGEN_BATCH;
+	progress.start("projections", groups);
+	projections.resize((size_t)n * kPad);
+	pool.parallelFor(0, groups, [&](int g) {
+		int begin = g * EIGEN_BATCH;
+		projectGroup(faces.rowRange(begin, min(begin + EIGEN_BATCH, n)), projections.get() + (size_t)begin * kPad);
+		progress.advance();
+	});
+
+	LOG_INFO("EIGENFACES: {} components for {} variance ({} sampled), {}", k, retainedVariance,
+		values.rows, quantize ? "int16" : "float32");
+}
+
+void EigenFaceModel::predictBatch(const Mat &faces, int *outLabels, double *confidences) const
+{
+	if (faces.cols != dim || faces.type() != CV_8UC1)
+		CV_Error(CV_StsBadArg, "Faces must be CV_8UC1 rows the size of the training images.");
+	vector<float> projected((size_t)EIGEN_BATCH * kPad);
+	float *out = &projected[0];
+	for (int begin = 0; begin < faces.rows; begin += EIGEN_BATCH) {
+		int end = min(begin + EIGEN_BATCH, faces.rows);
+		projectGroup(faces.rowRange(begin, end), out);
+		for (int f = begin; f < end; f++)
+			nearest(out + (size_t)(f - begin) * kPad, outLabels[f], confidences[f]);
+	}
+}
+
+void EigenFaceModel::predict(InputArray _src, int &label, double &confidence) const
+{
+	Mat src = _src.getMat();
+	if (n == 0)
+		CV_Error(CV_StsError, "This model is not computed yet. Did you call train?");
+	if ((int)src.total() != dim)
+		CV_Error(CV_StsBadArg, "Wrong input image size.");
+	Mat face;
+	if (src.type() == CV_8UC1 && src.isContinuous())
+		face = src.reshape(1, 1);
+	else
+		src.reshape(1, 1).convertTo(face, CV_8U); // copies into a continuous row
+	predictBatch(face, &label, &confidence);
+}
+
+int EigenFaceModel::predict(InputArray src) const
+{
+	int label;
+	double confidence;
+	predict(src, label, confidence);
+	return label;
+}
+
+void EigenFaceModel::save(FileStorage &fs) const
+{
+	Mat trained(n, k, CV_32F);
+	for (int i = 0; i < n; i++)
+		std::copy(projections.get() + (size_t)i * kPad, projections.get() + (size_t)i * kPad + k, trained.ptr<float>(i));
+	fs << "retainedVariance" << retainedVariance;
+	fs << "maxComponents" << maxComponents;
+	fs << "quantize" << (int)quantize;
+	fs << "mean" << mean;
+	fs << "basis" << basis;
+	fs << "projections" << trained;
+	fs << "labels" << labels;
+}
+
+void EigenFaceModel::load(const FileStorage &fs)
+{
+	int quantized = 0;
+	Mat trained;
+	fs["retainedVariance"] >> retainedVariance;
+	fs["maxComponents"] >> maxComponents;
+	fs["quantize"] >> quantized;
+	fs["mean"] >> mean;
+	fs["basis"] >> basis;
+	fs["projections"] >> trained;
+	fs["labels"] >> labels;
+	quantize = quantized != 0;
+	build();
+
+	n = trained.rows;
+	projections.resize((size_t)n * kPad);
+	for (int i = 0; i < n; i++)
+		std::copy(trained.ptr<float>(i), trained.ptr<float>(i) + k, projections.get() + (size_t)i * kPad);
+}
+
+void compareWithStock(const vector<Mat> &images, const vector<int> &labels)
+{
+	// Every 4th image is held out, the rest is the training set.
+	vector<Mat> trainImages, testImages;
+	vector<int> trainLabels, testLabels;
+	for (size_t i = 0; i < images.size(); i++) {
+		if (i % 4 == 0) {
+			testImages.push_back(images[i]);
+			testLabels.push_back(labels[i]);
+		}
+		else {
+			trainImages.push_back(images[i]);
+			trainLabels.push_back(labels[i]);
+		}
+	}
+	if (testImages.empty() || trainImages.empty()) {
+		LOG_ERROR("EIGEN CHECK: not enough faces");
+		return;
+	}
+	int tests = (int)testImages.size();
+	LOG_INFO("EIGEN CHECK: training on {} faces, testing on {}", trainImages.size(), tests);
+
+	Ptr<FaceRecognizer> stock = createEigenFaceRecognizer();
+	stock->train(trainImages, trainLabels);
+	vector<int> stockLabels(tests);
+	int stockCorrect = 0;
+	double start = (double)getTickCount();
+	for (int i = 0; i < tests; i++) {
+		stockLabels[i] = stock->predict(testImages[i]);
+		stockCorrect += stockLabels[i] == testLabels[i];
+	}
+	double stockMs = ((double)getTickCount() - start) * 1000 / getTickFrequency() / tests;
+	LOG_INFO("EIGEN CHECK: stock {} components, {}/{} correct, {} ms per face",
+		stock->getMat("eigenvectors").cols, stockCorrect, tests, stockMs);
+
+	Mat batch(tests, (int)testImages[0].total(), CV_8UC1);
+	for (int i = 0; i < tests; i++) {
+		Mat row = batch.row(i);
+		testImages[i].reshape(1, 1).copyTo(row);
+	}
+
+	for (int quantized = 0; quantized < 2; quantized++) {
+		EigenFaceModel model(EIGEN_RETAINED_VARIANCE, 0, quantized != 0);
+		model.train(trainImages, trainLabels);
+
+		int correct = 0, agree = 0;
+		start = (double)getTickCount();
+		for (int i = 0; i < tests; i++) {
+			int label = model.predict(testImages[i]);
+			correct += label == testLabels[i];
+			agree += label == stockLabels[i];
+		}
+		double ms = ((double)getTickCount() - start) * 1000 / getTickFrequency() / tests;
+
+		vector<int> batchLabels(tests);
+		vector<double> batchConfidences(tests);
+		start = (double)getTickCount();
+		model.predictBatch(batch, &batchLabels[0], &batchConfidences[0]);
+		double batchMs = ((double)getTickCount() - start) * 1000 / getTickFrequency() / tests;
+
+		const char *precision = quantized ? "int16" : "float32";
+		LOG_INFO("EIGEN CHECK: {} {} components, {}/{} correct, agrees with stock on {}",
+			precision, model.components(), correct, tests, agree);
+		LOG_INFO("EIGEN CHECK: {} {} ms per face, {} ms batched", precision, ms, batchMs);
+	}
+}
@@ -0,0 +1,51 @@
+#include "FaceBatch.h"
+#include "ThreadPool.h"
+#include "EigenFaces.h"
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+Mat batchFace(const Mat& batch, int i, Size faceSize)
+{
+	return batch.row(i).reshape(1, faceSize.height);
+}
+
+void recognizeFaces(const Mat& gray, const vector<Rect>& faces, Size faceSize,
+	const Ptr<FaceRecognizer>& model, Mat& batch, vector<FaceResult>& results)
+{
+	results.resize(faces.size());
+	if (faces.empty())
+		return;
+	// Only reallocates when more faces than ever before show up.
+	if (batch.rows < (int)faces.size() || batch.cols != faceSize.area())
+		batch.create((int)faces.size(), faceSize.area(), CV_8UC1);
+	// Our Eigenfaces model predicts groups of faces in one pass over its basis.
+	const EigenFaceModel *eigen = dynamic_cast<const EigenFaceModel *>((FaceRecognizer *)model);
+	// Runs on the app's pool, so a frame full of faces borrows cores from idle streams.
+	ThreadPool::shared().parallelFor(0, (int)faces.size(), [&](int i) {
+		// Resizing straight into the batch row, it's already the right size and type.
+		Mat face = batchFace(batch, i, faceSize);
+		cv::resize(gray(faces[i]), face, faceSize, 1.0, 1.0, INTER_CUBIC);
+		FaceResult& r = results[i];
+		r.box = faces[i];
+		r.label = -1;
+		r.confidence = 0.0;
+		if (!eigen)
+			model->predict(face, r.label, r.confidence);
+	});
+	if (!eigen)
+		return;
+	int groups = ((int)faces.size() + EIGEN_BATCH - 1) / EIGEN_BATCH;
+	ThreadPool::shared().parallelFor(0, groups, [&](int g) {
+		int begin = g * EIGEN_BATCH;
+		int end = min(begin + EIGEN_BATCH, (int)faces.size());
+		int labels[EIGEN_BATCH];
+		double confidences[EIGEN_BATCH];
+		eigen->predictBatch(batch.rowRange(begin, end), labels, confidences);
+		for (int i = begin; i < end; i++) {
+			results[i].label = labels[i - begin];
+			results[i].confidence = confidences[i - begin];
+		}
+	});
+}
@@ -0,0 +1,31 @@
+#ifndef FACE_BATCH
+#define FACE_BATCH
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+// Result of recognizing one detected face.
+struct FaceResult
+{
+	cv::Rect box;			// where the face is in the frame
+	int label;				// predicted label, -1 if none
+	double confidence;		// distance reported by the model
+};
+
+// Recognizes every face of a frame in one go.
+//
+// All faces are cropped out of gray and resized to faceSize into one contiguous
+// buffer (batch, one face per row, reused between frames), then predicted in
+// parallel on the ThreadPool. The model is only read, predict() is const, so the
+// threads share it. An EigenFaceModel gets the faces in groups of EIGEN_BATCH rows
+// through predictBatch() instead of one at a time.
+// results[i] belongs to faces[i].
+void recognizeFaces(const cv::Mat& gray, const std::vector<cv::Rect>& faces, cv::Size faceSize,
+	const cv::Ptr<cv::FaceRecognizer>& model, cv::Mat& batch, std::vector<FaceResult>& results);
+
+// Row i of the batch as a faceSize image (no copy).
+cv::Mat batchFace(const cv::Mat& batch, int i, cv::Size faceSize);
+
+#endif // FACE_BATCH
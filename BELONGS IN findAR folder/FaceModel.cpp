@@ -0,0 +1,128 @@
+#include "FaceModel.h"
+#include "FaceTrainer.h"
+#include "ThreadPool.h"
+#include "Log.h"
+#include <cctype>
+
+using namespace cv;
+using namespace std;
+
+FaceModel::FaceModel(Factory create, Ptr<FaceRecognizer> model,
+	const vector<Mat>& images, const vector<int>& labels, const vector<string>& names)
+	: create(create), model(model), images(images), labels(labels), names(names),
+	enrolling(false), training(false), enrollSource(0), frameCount(0), trainingPool(0)
+{
+}
+
+FaceModel::~FaceModel()
+{
+	if (trainer.joinable())
+		trainer.join();
+	delete trainingPool;
+}
+
+Ptr<FaceRecognizer> FaceModel::get()
+{
+	lock_guard<mutex> lock(modelLock);
+	return model;
+}
+
+string FaceModel::name(int label)
+{
+	lock_guard<mutex> lock(modelLock);
+	if (label >= 0 && label < (int)names.size())
+		return names[label];
+	return "NOT RECOGNIZED";
+}
+
+bool FaceModel::startEnroll(const string& name, const void *source)
+{
+	lock_guard<mutex> lock(sampleLock);
+	if (enrolling || training || name.empty())
+		return false;
+	enrollName = name;
+	enrollName[0] = toupper(enrollName[0]); // commands arrive lower case
+	samples.clear();
+	frameCount = 0;
+	enrollSource = source;
+	enrolling = true;
+	LOG_INFO("ENROLL START: {}", enrollName);
+	return true;
+}
+
+void FaceModel::addSample(const Mat& face, const void *source)
+{
+	if (!isEnrolling(source))
+		return;
+	// enrolling is only turned off under the lock, so exactly one caller starts the trainer.
+	lock_guard<mutex> lock(sampleLock);
+	if (!isEnrolling(source))
+		return;
+	if (frameCount++ % ENROLL_FRAME_STEP != 0)
+		return;
+	samples.push_back(face.clone()); // face is a view into this frame's buffers
+	if ((int)samples.size() < ENROLL_SAMPLES)
+		return;
+
+	// Got enough faces, hand them to the training thread.
+	enrolling = false;
+	training = true;
+	int newLabel;
+	{
+		lock_guard<mutex> lock(modelLock);
+		newLabel = (int)names.size();
+	}
+	if (trainer.joinable())
+		trainer.join(); // previous run has already finished, training was false
+	trainer = thread(&FaceModel::train, this, samples, newLabel);
+	samples.clear();
+}
+
+void FaceModel::train(vector<Mat> newImages, int newLabel)
+{
+	LOG_INFO("ENROLL TRAINING: {} (label {})", enrollName, newLabel);
+	vector<int> newLabels(newImages.size(), newLabel);
+	Ptr<FaceRecognizer> current = get();
+	Ptr<FaceRecognizer> next;
+	if (!trainingPool)
+		trainingPool = new ThreadPool(max(1, (int)thread::hardware_concurrency() / 2));
+	TrainProgress progress;
+	try {
+		// Stock LBPH or LbphFaceModel ("FaceRecognizer.LBPHFast").
+		if (current->name().find("FaceRecognizer.LBPH") == 0) {
+			// LBPH can be extended in place, but the live model is being used by the
+			// frame loop, so extend a copy of it instead.
+			FileStorage out(".xml", FileStorage::WRITE + FileStorage::MEMORY);
+			current->save(out);
+			string data = out.releaseAndGetString();
+			FileStorage in(data, FileStorage::READ + FileStorage::MEMORY);
+			next = create();
+			next->load(in);
+			updateFaces(*next, newImages, newLabels, *trainingPool, progress);
+		}
+		else {
+			// Eigenfaces/Fisherfaces have to be rebuilt from the whole set.
+			vector<Mat> allImages = images;
+			vector<int> allLabels = labels;
+			allImages.insert(allImages.end(), newImages.begin(), newImages.end());
+			allLabels.insert(allLabels.end(), newLabels.begin(), newLabels.end());
+			next = create();
+			trainFaces(*next, allImages, allLabels, *trainingPool, progress);
+		}
+	}
+	catch (cv::Exception& e) {
+		LOG_ERROR("Error enrolling \"{}\". Reason: {}", enrollName, e.msg);
+		training = false;
+		return;
+	}
+
+	images.insert(images.end(), newImages.begin(), newImages.end());
+	labels.insert(labels.end(), newLabels.begin(), newLabels.end());
+	{
+		lock_guard<mutex> lock(modelLock);
+		model = next;
+		names.push_back(enrollName);
+	}
+	LOG_INFO("ENROLL DONE: {}", enrollName);
+	training = false;
+}
@@ -0,0 +1,83 @@
+#ifndef FACE_MODEL
+#define FACE_MODEL
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+class ThreadPool;
+
+// Number of face crops captured from the live feed when enrolling a new person.
+const int ENROLL_SAMPLES = 20;
+// Only every Nth frame is sampled so the crops aren't all the same pose.
+const int ENROLL_FRAME_STEP = 2;
+
+// Holds the face recognition model used by the frame loop and lets new people be
+// enrolled while the app is running.
+//
+// The frame loop grabs the current model with get() once per frame. Enrollment collects
+// face crops from calcFace() of one stream, then builds the new model on a background thread and swaps
+// it in when it's done, so recognition never waits on training. LBPH models are extended
+// with update() on a copy; everything else (Eigenfaces, Fisherfaces) is retrained. Either
+// runs in parallel on a pool of its own (see trainFaces() and updateFaces()).
+class FaceModel
+{
+public:
+	typedef std::function<cv::Ptr<cv::FaceRecognizer>()> Factory;
+
+	// images/labels are the training set the model was trained with, names[label] is the
+	// person's display name.
+	FaceModel(Factory create, cv::Ptr<cv::FaceRecognizer> model,
+		const std::vector<cv::Mat>& images, const std::vector<int>& labels,
+		const std::vector<std::string>& names);
+	~FaceModel();
+
+	// Current model. Cheap, safe to call every frame.
+	cv::Ptr<cv::FaceRecognizer> get();
+	// Display name for a predicted label, "NOT RECOGNIZED" if unknown.
+	std::string name(int label);
+
+	// Start capturing faces for a new person from source, which identifies the stream
+	// (any pointer, only compared). Returns false if an enrollment or retrain is
+	// already in progress.
+	bool startEnroll(const std::string& name, const void *source);
+	bool isEnrolling() const { return enrolling; }
+	bool isEnrolling(const void *source) const { return enrolling && enrollSource == source; }
+	bool isTraining() const { return training; }
+	// Offer a resized grayscale face crop from the current frame of source. Safe to call
+	// from several streams at once, faces from other streams than the enrolling one are
+	// ignored.
+	void addSample(const cv::Mat& face, const void *source);
+
+private:
+	void train(std::vector<cv::Mat> newImages, int newLabel);
+
+	Factory create;
+	cv::Ptr<cv::FaceRecognizer> model;
+	std::mutex modelLock;	// guards model and names
+
+	std::vector<cv::Mat> images;	// only touched by the training thread once started
+	std::vector<int> labels;
+	std::vector<std::string> names;
+
+	std::atomic<bool> enrolling;
+	std::atomic<bool> training;
+	std::atomic<const void *> enrollSource;
+	std::mutex sampleLock;	// guards enrollName, samples, frameCount and starting trainer
+	std::string enrollName;
+	std::vector<cv::Mat> samples;
+	int frameCount;
+
+	std::thread trainer;
+	// Not the shared pool: the frame loop helps out with whatever the shared pool has
+	// queued while it waits for its filters, a block of training would stall a frame.
+	ThreadPool *trainingPool;
+};
+
+#endif // FACE_MODEL
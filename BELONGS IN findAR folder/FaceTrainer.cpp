@@ -0,0 +1,142 @@
+#include "FaceTrainer.h"
+#include "EigenFaces.h"
+#include "LbphFaces.h"
+#include "ThreadPool.h"
+#include "Log.h"
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+TrainProgress::TrainProgress(Callback callback)
+	: callback(callback), steps(1), done(0), reported(-1)
+{
+}
+
+void TrainProgress::start(const string& name, int count)
+{
+	stage = name;
+	steps = max(1, count);
+	done = 0;
+	reported = -1;
+	advance(0);
+}
+
+void TrainProgress::advance(int count)
+{
+	int tenth = (done += count) * 10 / steps;
+	int last = reported;
+	// Whoever moves it past the next 10% reports it, once.
+	while (tenth > last) {
+		if (reported.compare_exchange_weak(last, tenth)) {
+			if (callback)
+				callback(stage, tenth * 10);
+			else
+				LOG_INFO("TRAINING: {} {}%", stage, tenth * 10);
+			break;
+		}
+	}
+}
+
+void trainFaces(FaceRecognizer& model, const vector<Mat>& images, const vector<int>& labels,
+	ThreadPool& pool, TrainProgress& progress)
+{
+	if (EigenFaceModel *eigen = dynamic_cast<EigenFaceModel *>(&model)) {
+		eigen->train(images, labels, pool, progress);
+	}
+	else if (LbphFaceModel *lbph = dynamic_cast<LbphFaceModel *>(&model)) {
+		lbph->train(images, labels, pool, progress);
+	}
+	else {
+		progress.start("training", 1);
+		model.train(images, labels);
+		progress.advance();
+	}
+}
+
+void updateFaces(FaceRecognizer& model, const vector<Mat>& images, const vector<int>& labels,
+	ThreadPool& pool, TrainProgress& progress)
+{
+	if (LbphFaceModel *lbph = dynamic_cast<LbphFaceModel *>(&model)) {
+		lbph->update(images, labels, pool, progress);
+	}
+	else {
+		progress.start("updating", 1);
+		model.update(images, labels);
+		progress.advance();
+	}
+}
+
+void trainFaces(FaceRecognizer& model, const vector<Mat>& images, const vector<int>& labels)
+{
+	TrainProgress progress;
+	double start = (double)getTickCount();
+	trainFaces(model, images, labels, ThreadPool::shared(), progress);
+	LOG_INFO("TRAINING: {} faces in {} ms", images.size(),
+		((double)getTickCount() - start) * 1000 / getTickFrequency());
+}
+
+// Faces that look alike per person: a smooth random pattern for each person, every
+// sample of it a little brighter or darker and noisy.
+static void syntheticGallery(Size faceSize, int people, int perPerson, vector<Mat>& images, vector<int>& labels)
+{
+	RNG rng(0x5eed);
+	for (int p = 0; p < people; p++) {
+		Mat coarse(6, 5, CV_32F), person;
+		rng.fill(coarse, RNG::UNIFORM, Scalar(40), Scalar(216));
+		resize(coarse, person, faceSize, 0, 0, INTER_CUBIC);
+		for (int s = 0; s < perPerson; s++) {
+			Mat noise(faceSize, CV_32F), face;
+			rng.fill(noise, RNG::NORMAL, Scalar(0), Scalar(12));
+			Mat sample = person + noise;
+			sample.convertTo(face, CV_8U, 1, rng.uniform(-20.0, 20.0));
+			images.push_back(face);
+			labels.push_back(p);
+		}
+	}
+}
+
+// Milliseconds task takes on the pool. The calling thread only waits, so exactly the
+// pool's threads do the work.
+static double timeOnPool(ThreadPool& pool, function<void()> task)
+{
+	TaskGroup group;
+	double start = (double)getTickCount();
+	pool.run(group, task);
+	while (!group.done())
+		this_thread::sleep_for(chrono::milliseconds(1));
+	return ((double)getTickCount() - start) * 1000 / getTickFrequency();
+}
+
+void benchmarkTraining(Size faceSize, int faces)
+{
+	const int perPerson = 20;
+	vector<Mat> images;
+	vector<int> labels;
+	syntheticGallery(faceSize, max(2, faces / perPerson), perPerson, images, labels);
+	LOG_INFO("TRAIN BENCH: {} synthetic {}x{} faces of {} people", images.size(),
+		faceSize.width, faceSize.height, images.size() / perPerson);
+
+	int cores = max(1, (int)thread::hardware_concurrency());
+	double eigenSerial = 0, lbphSerial = 0;
+	for (int threads = 1; ; threads = min(threads * 2, cores)) {
+		ThreadPool pool(threads);
+		TrainProgress quiet([](const string&, int) {});
+		EigenFaceModel eigen;
+		LbphFaceModel lbph;
+		double eigenMs = timeOnPool(pool, [&]() { trainFaces(eigen, images, labels, pool, quiet); });
+		double lbphMs = timeOnPool(pool, [&]() { trainFaces(lbph, images, labels, pool, quiet); });
+		if (threads == 1) {
+			eigenSerial = eigenMs;
+			lbphSerial = lbphMs;
+		}
+		LOG_INFO("TRAIN BENCH: {} threads, eigenfaces {} ms ({}x), LBPH {} ms ({}x)", threads,
+			eigenMs, eigenSerial / eigenMs, lbphMs, lbphSerial / lbphMs);
+		if (threads == cores)
+			break;
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef FACE_TRAINER
+#define FACE_TRAINER
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+class ThreadPool;
+
+// How far a training run got. Training works through a few stages (e.g. "data matrix",
+// "components"), each made of steps that advance() counts off from any thread.
+class TrainProgress
+{
+public:
+	// Called with the stage and 0, 10, ..., 100 percent.
+	typedef std::function<void(const std::string& stage, int percent)> Callback;
+
+	// Without a callback, progress is logged.
+	explicit TrainProgress(Callback callback = Callback());
+
+	// Starts the next stage. Not while another thread may still call advance().
+	void start(const std::string& stage, int steps);
+	void advance(int steps = 1);
+
+private:
+	Callback callback;
+	std::string stage;
+	int steps;
+	std::atomic<int> done;
+	std::atomic<int> reported;	// last 10% reported
+};
+
+// Trains model on the pool. EigenFaceModel and LbphFaceModel spread the work over the
+// pool's threads, any other FaceRecognizer is trained with its own train().
+void trainFaces(cv::FaceRecognizer& model, const std::vector<cv::Mat>& images,
+	const std::vector<int>& labels, ThreadPool& pool, TrainProgress& progress);
+// Same on the shared pool, logging progress and the time it took.
+void trainFaces(cv::FaceRecognizer& model, const std::vector<cv::Mat>& images,
+	const std::vector<int>& labels);
+// Adds faces to a trained model on the pool, for models that support update() (LBPH).
+void updateFaces(cv::FaceRecognizer& model, const std::vector<cv::Mat>& images,
+	const std::vector<int>& labels, ThreadPool& pool, TrainProgress& progress);
+
+// Trains EigenFaceModel and LbphFaceModel on a synthetic gallery of faces faceSize big,
+// with 1, 2, 4, ... threads up to one per core, and logs the times and speedups.
+void benchmarkTraining(cv::Size faceSize, int faces);
+
+#endif // FACE_TRAINER
@@ -0,0 +1,70 @@
+#include "FaceWorker.h"
+#include "FaceBatch.h"
+#include "FrameBus.h"
+#include "Log.h"
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <opencv2/objdetect/objdetect.hpp>
+
+using namespace cv;
+using namespace std;
+
+string faceBusName(int stream)
+{
+	return "/findAR-faces-" + to_string(stream);
+}
+
+int runFaceWorker(const string& busName, const string& cascadePath, const Ptr<FaceRecognizer>& model, Size faceSize)
+{
+	CascadeClassifier cascade;
+	if (!cascade.load(cascadePath)) {
+		LOG_ERROR("FACE WORKER: cannot load {}", cascadePath);
+		return 1;
+	}
+	Mat batch;
+	vector<Rect> faces;
+	vector<FaceResult> results;
+	while (true) {
+		FrameBus *bus = FrameBus::attach(busName);
+		if (!bus) {
+			this_thread::sleep_for(chrono::milliseconds(FACE_WORKER_RETRY_MS));
+			continue;
+		}
+		int channel = bus->claim();
+		if (channel < 0) {
+			LOG_ERROR("FACE WORKER: {} has {} workers already", busName, FRAME_BUS_CHANNELS);
+			delete bus;
+			return 1;
+		}
+		LOG_INFO("FACE WORKER: attached to {}", busName);
+
+		BusFrame frame;
+		while (bus->publisherAlive()) {
+			if (!bus->next(frame, FACE_WORKER_RETRY_MS))
+				continue;
+			cascade.detectMultiScale(frame.image, faces);
+			recognizeFaces(frame.image, faces, faceSize, model, batch, results);
+			// The app lapped the ring while we worked, the boxes may be from two frames.
+			if (!bus->intact(frame))
+				continue;
+			BusResult result;
+			result.frame = frame.frame;
+			result.count = min((int)results.size(), FRAME_BUS_FACES);
+			for (int i = 0; i < result.count; i++) {
+				BusFace &face = result.faces[i];
+				face.x = results[i].box.x;
+				face.y = results[i].box.y;
+				face.width = results[i].box.width;
+				face.height = results[i].box.height;
+				face.label = results[i].label;
+				face.confidence = results[i].confidence;
+			}
+			bus->post(channel, result);
+		}
+		LOG_INFO("FACE WORKER: the app closed {}, waiting for it", busName);
+		delete bus;
+		this_thread::sleep_for(chrono::milliseconds(FACE_WORKER_RETRY_MS));
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef FACE_WORKER
+#define FACE_WORKER
+
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+// Results older than this come from a worker that hung or died, the app recognizes
+// faces itself again.
+const int FACE_WORKER_MAX_AGE_MS = 500;
+// How long a worker waits for a frame, or for the app to come (back), before it looks again.
+const int FACE_WORKER_RETRY_MS = 1000;
+
+// Name of the FrameBus the app publishes a stream's frames on for face workers.
+std::string faceBusName(int stream);
+
+// Runs this process as a face worker ("findAR --face-worker=N") for stream N: takes
+// grayscale frames off the stream's FrameBus, finds and recognizes the faces in them
+// and posts the boxes and labels back for calcFace()'s overlay. Runs until killed, and
+// keeps running if the app exits, picking up again when it's back. Returns 1 if it
+// can't start.
+int runFaceWorker(const std::string& busName, const std::string& cascadePath,
+	const cv::Ptr<cv::FaceRecognizer>& model, cv::Size faceSize);
+
+#endif // FACE_WORKER
@@ -0,0 +1,123 @@
+#include "Foveator.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+Foveator::Foveator()
+	: on(false), cx(0.5), cy(0.5), fraction(0.5), periphery(0.5), fade(0.15), weightFade(0)
+{
+}
+
+void Foveator::setCenter(double x, double y)
+{
+	cx = max(0.0, min(1.0, x));
+	cy = max(0.0, min(1.0, y));
+}
+
+void Foveator::setSize(double size)
+{
+	if (size > 0 && size <= 1)
+		fraction = size;
+}
+
+void Foveator::setScale(double scale)
+{
+	if (scale > 0 && scale <= 1)
+		periphery = scale;
+}
+
+void Foveator::setFeather(double feather)
+{
+	if (feather > 0 && feather <= 0.5)
+		fade = feather;
+}
+
+Rect Foveator::region(Size frame) const
+{
+	int w = max(1, cvRound(frame.width * fraction));
+	int h = max(1, cvRound(frame.height * fraction));
+	// Near the edges the fovea slides back in instead of shrinking.
+	int x = cvRound(frame.width * cx) - w / 2;
+	int y = cvRound(frame.height * cy) - h / 2;
+	x = max(0, min(frame.width - w, x));
+	y = max(0, min(frame.height - h, y));
+	return Rect(x, y, w, h);
+}
+
+void Foveator::updateWeights(Size size)
+{
+	if (size == weightSize && fade == weightFade)
+		return;
+	weightSize = size;
+	weightFade = fade;
+	weights.create(size, CV_32FC1);
+	float rampX = (float)max(1.0, size.width * fade);
+	float rampY = (float)max(1.0, size.height * fade);
+	for (int y = 0; y < size.height; y++) {
+		float *row = weights.ptr<float>(y);
+		float wy = min(1.0f, min(y + 0.5f, size.height - y - 0.5f) / rampY);
+		for (int x = 0; x < size.width; x++) {
+			float wx = min(1.0f, min(x + 0.5f, size.width - x - 0.5f) / rampX);
+			float w = min(wx, wy);
+			row[x] = w * w * (3 - 2 * w); // smoothstep, no visible kink where the fade starts
+		}
+	}
+	inverse.create(size, CV_32FC1);
+	inverse = Scalar::all(1.0);
+	inverse -= weights;
+}
+
+const Mat& Foveator::peripheryOf(FrameCache& frame, bool gray)
+{
+	for (int level = 1; level < FRAME_CACHE_LEVELS; level++) {
+		if (fabs(periphery - 1.0 / (1 << level)) < 1e-6)
+			return gray ? frame.grayPyramid(level) : frame.pyramid(level);
+	}
+	cv::resize(gray ? frame.gray() : frame.image(), small, Size(), periphery, periphery, INTER_AREA);
+	return small;
+}
+
+Mat Foveator::apply(FrameCache& frame, const Filter& filter, bool luma)
+{
+	Rect roi = region(frame.size());
+
+	lowFrame.reset(peripheryOf(frame, luma));
+	Mat low = filter(lowFrame);
+	cv::resize(low, result, frame.size(), 0, 0, INTER_LINEAR);
+
+	// A view, filters only read the frame.
+	foveaFrame.reset(luma ? frame.gray()(roi) : frame.image()(roi));
+	Mat high = filter(foveaFrame);
+
+	updateWeights(roi.size());
+	Mat target = result(roi);
+	// Blended in place: target is the fovea's part of the scaled up periphery.
+	blendLinear(high, target, weights, inverse, target);
+	lowFrame.retire();
+	foveaFrame.retire();
+	return result;
+}
+
+void Foveator::detect(FrameCache& frame, const Detector& detector, vector<Rect>& found)
+{
+	const Mat& image = frame.gray();
+	Rect roi = region(image.size());
+	found.clear();
+
+	const Mat& low = peripheryOf(frame, true);
+	detector(low, hits);
+	double up = (double)image.cols / low.cols;
+	for (size_t i = 0; i < hits.size(); i++) {
+		Rect r(cvRound(hits[i].x * up), cvRound(hits[i].y * up), cvRound(hits[i].width * up), cvRound(hits[i].height * up));
+		Point center(r.x + r.width / 2, r.y + r.height / 2);
+		if (!roi.contains(center))
+			found.push_back(r & Rect(0, 0, image.cols, image.rows));
+	}
+
+	detector(image(roi), hits);
+	for (size_t i = 0; i < hits.size(); i++)
+		found.push_back(Rect(hits[i].x + roi.x, hits[i].y + roi.y, hits[i].width, hits[i].height));
+}
@@ -0,0 +1,88 @@
+#ifndef FOVEATOR
+#define FOVEATOR
+
+#include <vector>
+#include <functional>
+
+#include <opencv2/core/core.hpp>
+
+#include "FrameCache.h"
+
+// Foveated processing for the headset view. Only the center of the view is seen sharply,
+// so only there a filter needs to run at full quality.
+//
+// apply() runs a filter twice: on the whole frame scaled down to scale(), which is then
+// scaled back up for the periphery, and at native resolution on the fovea, a region
+// around center() that is size() of the frame in each direction. The fovea is faded into
+// the periphery over its outer feather() part, so there's no visible edge. With the
+// defaults both passes work on a quarter of the pixels, and on images of the same size,
+// so the stream's scratch matrices aren't reallocated between them.
+//
+// Each pass gets its own FrameCache. Scales of 1/2, 1/4 and 1/8 take the periphery from
+// the frame's pyramid, so it's shared with anything else that asks for that level.
+// Filters that only look at gray() get both passes in grayscale, so a YUV frame is
+// never converted to BGR for them.
+//
+// detect() does the same for detectors: the whole frame is searched at the reduced
+// resolution and the fovea at full resolution.
+class Foveator
+{
+public:
+	// Runs a filter on a frame and returns the result, which has the frame's size.
+	typedef std::function<cv::Mat(FrameCache&)> Filter;
+	// Finds objects in an image.
+	typedef std::function<void(const cv::Mat&, std::vector<cv::Rect>&)> Detector;
+
+	Foveator();
+
+	void setEnabled(bool enable) { on = enable; }
+	bool enabled() const { return on; }
+
+	// Fovea center as fractions [0, 1] of the frame's width and height.
+	void setCenter(double x, double y);
+	double centerX() const { return cx; }
+	double centerY() const { return cy; }
+	// Fovea width and height as fractions (0, 1] of the frame's.
+	void setSize(double size);
+	double size() const { return fraction; }
+	// Resolution of the periphery (0, 1].
+	void setScale(double scale);
+	double scale() const { return periphery; }
+	// Part (0, 0.5] of the fovea's width/height faded into the periphery.
+	void setFeather(double feather);
+	double feather() const { return fade; }
+
+	// Where the fovea is in a frame of this size. Kept inside the frame.
+	cv::Rect region(cv::Size frame) const;
+
+	// The foveated result of filter on frame. The returned image is reused next call.
+	// luma if the filter only uses gray().
+	cv::Mat apply(FrameCache& frame, const Filter& filter, bool luma = false);
+	// Foveated detector on the frame's grayscale image. Periphery hits inside the fovea
+	// are dropped, the fovea search finds those more reliably.
+	void detect(FrameCache& frame, const Detector& detector, std::vector<cv::Rect>& found);
+
+private:
+	// The frame (or its grayscale image) at the periphery's resolution.
+	const cv::Mat& peripheryOf(FrameCache& frame, bool gray);
+	// Rebuilds the blending weights for a fovea of this size.
+	void updateWeights(cv::Size fovea);
+
+	bool on;
+	double cx, cy;
+	double fraction;
+	double periphery;
+	double fade;
+
+	cv::Mat small;			// frame at the periphery's resolution, if not a pyramid level
+	FrameCache lowFrame;	// derived images of the periphery pass
+	FrameCache foveaFrame;	// and of the fovea pass
+	cv::Mat result;			// periphery scaled back up with the fovea blended in
+	cv::Mat weights;		// fovea's weight per pixel, CV_32FC1
+	cv::Mat inverse;		// 1 - weights
+	cv::Size weightSize;	// fovea size the weights are for
+	double weightFade;		// feather the weights are for
+	std::vector<cv::Rect> hits;
+};
+
+#endif // FOVEATOR
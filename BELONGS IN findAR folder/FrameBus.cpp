@@ -0,0 +1,350 @@
+#include "FrameBus.h"
+#include "Log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <new>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+// Identifies a findAR frame bus, and its layout version.
+static const uint32_t FRAME_BUS_MAGIC = 0x46424b31;
+
+// Everything lives in the shared memory segment: this header, then the slots' pixels.
+// Only lock-free atomics are used, those work between processes mapping the same memory.
+struct FrameBus::Header
+{
+	struct Slot
+	{
+		atomic<uint32_t> sequence;	// odd while the app writes the slot
+		atomic<uint32_t> taken;		// a worker has the frame
+		atomic<uint64_t> frame;
+	};
+	struct Channel
+	{
+		atomic<int32_t> owner;		// pid of the worker posting here, 0 if free
+		atomic<uint32_t> sequence;	// odd while the worker writes result
+		atomic<int64_t> posted;		// when result was posted, ms of the monotonic clock
+		BusResult result;
+	};
+
+	atomic<uint32_t> magic;		// set last, the bus is ready once it's there
+	int32_t publisher;			// pid of the app
+	int rows;
+	int cols;
+	int type;
+	size_t slotBytes;
+	atomic<uint32_t> published;	// frames published so far, workers wait on it
+	atomic<int32_t> waiting;	// workers sleeping on published
+	Slot slots[FRAME_BUS_SLOTS];
+	Channel channels[FRAME_BUS_CHANNELS];
+};
+
+// Slot pixels start at a cache line.
+size_t FrameBus::headerBytes()
+{
+	return (sizeof(Header) + 63) & ~(size_t)63;
+}
+
+// Monotonic ms, the same clock in every process.
+static int64_t nowMs()
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameBus::FrameBus()
+	: owner(false), bytes(0), header(0), seen(0)
+{
+}
+
+uchar *FrameBus::pixels(int slot) const
+{
+	return (uchar *)header + headerBytes() + slot * header->slotBytes;
+}
+
+#ifdef __linux__
+
+static void futexWake(atomic<uint32_t> *word)
+{
+	// Not FUTEX_PRIVATE: the waiters are other processes.
+	syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+static void futexWait(atomic<uint32_t> *word, uint32_t value, int timeoutMs)
+{
+	timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+	// Returns right away if word isn't value anymore, so a frame published after the
+	// caller looked isn't missed.
+	syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, &timeout, 0, 0);
+}
+
+static bool processAlive(int32_t pid)
+{
+	return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+FrameBus::~FrameBus()
+{
+	if (header)
+		munmap(header, bytes);
+	if (owner)
+		shm_unlink(name.c_str());
+}
+
+FrameBus *FrameBus::create(const string& name, Size size, int type)
+{
+	// Workers still attached to a bus left over from a crash keep their mapping, they
+	// notice its app is gone and attach again.
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		LOG_WARN("FRAME BUS: cannot create {}: {}", name, strerror(errno));
+		return 0;
+	}
+	size_t slotBytes = ((size_t)size.area() * CV_ELEM_SIZE(type) + 63) & ~(size_t)63;
+	size_t bytes = headerBytes() + FRAME_BUS_SLOTS * slotBytes;
+	void *memory = MAP_FAILED;
+	if (ftruncate(fd, bytes) == 0)
+		memory = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		LOG_WARN("FRAME BUS: cannot map {}: {}", name, strerror(errno));
+		shm_unlink(name.c_str());
+		return 0;
+	}
+
+	FrameBus *bus = new FrameBus;
+	bus->name = name;
+	bus->owner = true;
+	bus->bytes = bytes;
+	bus->header = new (memory) Header();
+	bus->header->publisher = getpid();
+	bus->header->rows = size.height;
+	bus->header->cols = size.width;
+	bus->header->type = type;
+	bus->header->slotBytes = slotBytes;
+	bus->header->magic.store(FRAME_BUS_MAGIC, memory_order_release);
+	LOG_INFO("FRAME BUS: {} ready for {}x{} frames", name, size.width, size.height);
+	return bus;
+}
+
+FrameBus *FrameBus::attach(const string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0)
+		return 0;
+	struct stat info;
+	void *memory = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && (size_t)info.st_size >= headerBytes())
+		memory = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED)
+		return 0;
+
+	FrameBus *bus = new FrameBus;
+	bus->name = name;
+	bus->bytes = info.st_size;
+	bus->header = (Header *)memory;
+	// Not set up yet, or a different findAR.
+	if (bus->header->magic.load(memory_order_acquire) != FRAME_BUS_MAGIC ||
+		headerBytes() + FRAME_BUS_SLOTS * bus->header->slotBytes > bus->bytes) {
+		delete bus;
+		return 0;
+	}
+	bus->seen = bus->header->published.load();
+	return bus;
+}
+
+bool FrameBus::publish(const Mat& image, uint64_t frame)
+{
+	if (image.rows != header->rows || image.cols != header->cols || image.type() != header->type)
+		return false;
+	uint32_t count = header->published.load(memory_order_relaxed);
+	int index = count % FRAME_BUS_SLOTS;
+	Header::Slot &slot = header->slots[index];
+
+	uint32_t sequence = slot.sequence.load(memory_order_relaxed);
+	slot.sequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	Mat dst(header->rows, header->cols, header->type, pixels(index));
+	image.copyTo(dst);
+	slot.frame.store(frame, memory_order_relaxed);
+	slot.taken.store(0, memory_order_relaxed);
+	slot.sequence.store(sequence + 2, memory_order_release);
+
+	header->published.store(count + 1);
+	// The syscall is only made when a worker sleeps.
+	if (header->waiting.load() > 0)
+		futexWake(&header->published);
+	return true;
+}
+
+bool FrameBus::next(BusFrame& out, int timeoutMs)
+{
+	int64_t deadline = nowMs() + timeoutMs;
+	while (true) {
+		uint32_t count = header->published.load();
+		if (count == seen) {
+			int64_t left = deadline - nowMs();
+			if (left <= 0)
+				return false;
+			header->waiting++;
+			futexWait(&header->published, count, (int)left);
+			header->waiting--;
+			continue;
+		}
+		seen = count;
+
+		int index = (count - 1) % FRAME_BUS_SLOTS;
+		Header::Slot &slot = header->slots[index];
+		uint32_t sequence = slot.sequence.load(memory_order_acquire);
+		if (sequence & 1)
+			continue; // the app is already writing the next frame here
+		uint64_t frame = slot.frame.load(memory_order_relaxed);
+		// Another worker has it, wait for the next one.
+		uint32_t free = 0;
+		if (!slot.taken.compare_exchange_strong(free, 1))
+			continue;
+		atomic_thread_fence(memory_order_acquire);
+		if (slot.sequence.load(memory_order_relaxed) != sequence)
+			continue;
+
+		out.image = Mat(header->rows, header->cols, header->type, pixels(index));
+		out.frame = frame;
+		out.slot = index;
+		out.sequence = sequence;
+		return true;
+	}
+}
+
+bool FrameBus::intact(const BusFrame& frame) const
+{
+	atomic_thread_fence(memory_order_acquire);
+	return header->slots[frame.slot].sequence.load(memory_order_relaxed) == frame.sequence;
+}
+
+int FrameBus::claim()
+{
+	int32_t self = getpid();
+	for (int i = 0; i < FRAME_BUS_CHANNELS; i++) {
+		Header::Channel &channel = header->channels[i];
+		int32_t current = channel.owner.load();
+		// Free, or left behind by a worker that died.
+		if (current != 0 && processAlive(current))
+			continue;
+		if (channel.owner.compare_exchange_strong(current, self)) {
+			channel.posted.store(0);
+			return i;
+		}
+	}
+	return -1;
+}
+
+void FrameBus::post(int index, const BusResult& result)
+{
+	Header::Channel &channel = header->channels[index];
+	uint32_t sequence = channel.sequence.load(memory_order_relaxed);
+	channel.sequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(&channel.result, &result, sizeof(result));
+	channel.sequence.store(sequence + 2, memory_order_release);
+	channel.posted.store(nowMs(), memory_order_release);
+}
+
+bool FrameBus::latest(BusResult& result, int maxAgeMs) const
+{
+	int64_t now = nowMs();
+	bool found = false;
+	BusResult copy;
+	for (int i = 0; i < FRAME_BUS_CHANNELS; i++) {
+		const Header::Channel &channel = header->channels[i];
+		if (channel.owner.load(memory_order_relaxed) == 0 || now - channel.posted.load(memory_order_acquire) > maxAgeMs)
+			continue;
+		uint32_t sequence = channel.sequence.load(memory_order_acquire);
+		if (sequence & 1)
+			continue; // being written, never wait for it
+		memcpy(&copy, &channel.result, sizeof(copy));
+		atomic_thread_fence(memory_order_acquire);
+		if (channel.sequence.load(memory_order_relaxed) != sequence)
+			continue;
+		if (copy.count < 0 || copy.count > FRAME_BUS_FACES)
+			continue;
+		if (!found || copy.frame > result.frame) {
+			result = copy;
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool FrameBus::publisherAlive() const
+{
+	return processAlive(header->publisher);
+}
+
+#else
+
+FrameBus::~FrameBus()
+{
+}
+
+FrameBus *FrameBus::create(const string& name, Size, int)
+{
+	LOG_WARN("FRAME BUS: {} needs Linux", name);
+	return 0;
+}
+
+FrameBus *FrameBus::attach(const string&)
+{
+	return 0;
+}
+
+bool FrameBus::publish(const Mat&, uint64_t)
+{
+	return false;
+}
+
+bool FrameBus::next(BusFrame&, int)
+{
+	return false;
+}
+
+bool FrameBus::intact(const BusFrame&) const
+{
+	return false;
+}
+
+int FrameBus::claim()
+{
+	return -1;
+}
+
+void FrameBus::post(int, const BusResult&)
+{
+}
+
+bool FrameBus::latest(BusResult&, int) const
+{
+	return false;
+}
+
+bool FrameBus::publisherAlive() const
+{
+	return false;
+}
+
+#endif // __linux__
@@ -0,0 +1,102 @@
+#ifndef FRAME_BUS
+#define FRAME_BUS
+
+#include <string>
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+
+// Frames kept in the ring. A worker has this many frame times to finish with a frame
+// before the app writes over it.
+const int FRAME_BUS_SLOTS = 4;
+// Workers that can post results on one bus at the same time.
+const int FRAME_BUS_CHANNELS = 4;
+// Faces a result has room for.
+const int FRAME_BUS_FACES = 32;
+
+// One face a worker found, in frame coordinates.
+struct BusFace
+{
+	int x, y, width, height;
+	int label;				// predicted label, -1 if none
+	double confidence;		// distance reported by the model
+};
+
+// What a worker found in one frame.
+struct BusResult
+{
+	uint64_t frame;			// number the frame was published with
+	int count;
+	BusFace faces[FRAME_BUS_FACES];
+};
+
+// A frame taken off the bus by a worker.
+struct BusFrame
+{
+	cv::Mat image;			// view of the bus's shared memory, no copy
+	uint64_t frame;
+	int slot;
+	uint32_t sequence;		// slot's sequence when it was taken, see intact()
+};
+
+// Hands frames to analysis workers in other processes and their results back.
+//
+// The app creates the bus, a named POSIX shared memory segment holding a ring of
+// FRAME_BUS_SLOTS frame slots and FRAME_BUS_CHANNELS result channels, and publishes
+// frames into it. Workers attach to it by name. Nothing on the bus ever makes the app
+// wait: slots and channels are seqlocks (a sequence number that is odd while they're
+// being written, readers check it didn't change while they read), the newest frame
+// simply overwrites the oldest slot, and results are read without locking, a result
+// caught while being written is skipped until the next frame.
+//
+// Workers sleep on a futex on the published frame count, the app only makes the wake
+// up call when a worker is sleeping. Every frame goes to one worker, so several workers
+// on one bus share the load. A worker that crashes only leaves its channel behind: its
+// results age out, and the next worker takes the channel over. If the app restarts,
+// workers notice the old bus is dead and attach to the new one.
+//
+// Linux only, create() and attach() return 0 elsewhere.
+class FrameBus
+{
+public:
+	~FrameBus();
+
+	// App side. Creates the bus for frames of size and type, replacing one left over
+	// from an earlier run. 0 on failure.
+	static FrameBus *create(const std::string& name, cv::Size size, int type);
+	// Copies image into the oldest slot and wakes a worker. False if it doesn't match
+	// the bus's size and type.
+	bool publish(const cv::Mat& image, uint64_t frame);
+	// Newest result of any worker posted within maxAgeMs. False if there is none, e.g.
+	// no worker is running.
+	bool latest(BusResult& result, int maxAgeMs) const;
+
+	// Worker side. Attaches to a bus the app created. 0 if there is none (yet).
+	static FrameBus *attach(const std::string& name);
+	// Claims a result channel, -1 if live workers have all of them.
+	int claim();
+	// Waits up to timeoutMs for a frame newer than the last one taken. The frame stays
+	// in the ring while the worker works on it, until the app laps the ring.
+	bool next(BusFrame& frame, int timeoutMs);
+	// False if the app has written over the frame since next() returned it, results
+	// from it may be garbage.
+	bool intact(const BusFrame& frame) const;
+	void post(int channel, const BusResult& result);
+	// False once the app that created the bus has exited.
+	bool publisherAlive() const;
+
+private:
+	struct Header;
+
+	FrameBus();
+	static size_t headerBytes();
+	uchar *pixels(int slot) const;
+
+	std::string name;
+	bool owner;			// created it, unlinks it when done
+	size_t bytes;
+	Header *header;
+	uint32_t seen;		// published count of the last frame next() looked at
+};
+
+#endif // FRAME_BUS
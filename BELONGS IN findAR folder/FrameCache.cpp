@@ -0,0 +1,103 @@
+#include "FrameCache.h"
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+void FrameCache::reset(const Frame& frame)
+{
+	retire();
+	source = frame;
+}
+
+void FrameCache::reset(const Mat& image)
+{
+	retire();
+	source.format = image.channels() == 1 ? FRAME_GRAY : FRAME_BGR;
+	source.data = image;
+}
+
+void FrameCache::retire()
+{
+	// A view of the old frame, the next conversion must not write into it.
+	if (source.format == FRAME_NV12)
+		grayEntry.image.release();
+	// Lets go of the camera's buffer too, if the frame viewed one.
+	source = Frame();
+	bgrEntry.ready = false;
+	grayEntry.ready = false;
+	hsvEntry.ready = false;
+	integralEntry.ready = false;
+	for (int i = 0; i < FRAME_CACHE_LEVELS; i++) {
+		levels[i].ready = false;
+		grayLevels[i].ready = false;
+	}
+}
+
+template<typename Compute>
+const Mat& FrameCache::get(Entry& entry, Compute compute)
+{
+	// Double checked, so once it's there readers don't need the lock.
+	if (!entry.ready.load(memory_order_acquire)) {
+		lock_guard<mutex> guard(entry.lock);
+		if (!entry.ready.load(memory_order_relaxed)) {
+			compute(entry.image);
+			entry.ready.store(true, memory_order_release);
+		}
+	}
+	return entry.image;
+}
+
+const Mat& FrameCache::image()
+{
+	switch (source.format) {
+	case FRAME_YUYV:
+		return get(bgrEntry, [&](Mat& out) { cvtColor(source.data, out, CV_YUV2BGR_YUYV); });
+	case FRAME_NV12:
+		return get(bgrEntry, [&](Mat& out) { cvtColor(source.data, out, CV_YUV2BGR_NV12); });
+	default:
+		return source.data;
+	}
+}
+
+const Mat& FrameCache::gray()
+{
+	switch (source.format) {
+	case FRAME_GRAY:
+		return source.data;
+	case FRAME_NV12:
+		// The Y plane comes first, no copy needed.
+		return get(grayEntry, [&](Mat& out) { out = source.data.rowRange(0, source.size().height); });
+	case FRAME_YUYV:
+		// Every other byte, cheaper than going through BGR.
+		return get(grayEntry, [&](Mat& out) { cvtColor(source.data, out, CV_YUV2GRAY_YUYV); });
+	default:
+		return get(grayEntry, [&](Mat& out) { cvtColor(source.data, out, CV_BGR2GRAY); });
+	}
+}
+
+const Mat& FrameCache::hsv()
+{
+	return get(hsvEntry, [&](Mat& out) { cvtColor(image(), out, CV_BGR2HSV); });
+}
+
+const Mat& FrameCache::pyramid(int level)
+{
+	CV_Assert(level >= 0 && level < FRAME_CACHE_LEVELS);
+	if (level == 0)
+		return image();
+	return get(levels[level], [&](Mat& out) { pyrDown(pyramid(level - 1), out); });
+}
+
+const Mat& FrameCache::grayPyramid(int level)
+{
+	CV_Assert(level >= 0 && level < FRAME_CACHE_LEVELS);
+	if (level == 0)
+		return gray();
+	return get(grayLevels[level], [&](Mat& out) { pyrDown(grayPyramid(level - 1), out); });
+}
+
+const Mat& FrameCache::integral()
+{
+	return get(integralEntry, [&](Mat& out) { cv::integral(gray(), out, CV_32S); });
+}
@@ -0,0 +1,71 @@
+#ifndef FRAME_CACHE
+#define FRAME_CACHE
+
+#include <mutex>
+#include <atomic>
+
+#include <opencv2/core/core.hpp>
+
+#include "FrameSource.h"
+
+// Pyramid levels kept per frame, level 0 is the frame itself.
+const int FRAME_CACHE_LEVELS = 4;
+
+// Images derived from one camera frame, shared by everything that works on the frame.
+//
+// Each derived image is computed the first time somebody asks for it and then handed out
+// to every later caller, so a face overlay on top of a color mode doesn't convert the
+// frame to grayscale a second time. Getters can be called from several threads at once,
+// each image is still computed only once.
+//
+// Frames can come as the camera delivered them (see Frame). For YUYV and NV12 frames
+// gray() is the Y plane (a view of the frame for NV12) and image() converts to BGR only
+// when a filter needs color.
+//
+// Derived images belong to the cache: don't write into them, and don't keep them past
+// retire(). Their memory is reused for the next frame.
+class FrameCache
+{
+public:
+	// Starts a new frame. Nothing may use the cache while it's reset.
+	void reset(const Frame& frame);
+	// Same for a BGR or grayscale image.
+	void reset(const cv::Mat& image);
+	// Ends the frame: drops the reference to it and marks everything derived as stale.
+	void retire();
+
+	// The frame in BGR (or grayscale if that's what it is).
+	const cv::Mat& image();
+	cv::Size size() const { return source.size(); }
+
+	const cv::Mat& gray();
+	const cv::Mat& hsv();
+	// The frame halved level times (pyrDown), in color and in grayscale.
+	const cv::Mat& pyramid(int level);
+	const cv::Mat& grayPyramid(int level);
+	// Integral image of gray(), CV_32S, one row and column bigger than the frame.
+	const cv::Mat& integral();
+
+private:
+	struct Entry
+	{
+		Entry() : ready(false) {}
+		std::mutex lock;
+		std::atomic<bool> ready;
+		cv::Mat image;
+	};
+
+	// Computes the entry's image with compute(image) unless it's there already.
+	template<typename Compute>
+	const cv::Mat& get(Entry& entry, Compute compute);
+
+	Frame source;
+	Entry bgrEntry;
+	Entry grayEntry;
+	Entry hsvEntry;
+	Entry integralEntry;
+	Entry levels[FRAME_CACHE_LEVELS];
+	Entry grayLevels[FRAME_CACHE_LEVELS];
+};
+
+#endif // FRAME_CACHE
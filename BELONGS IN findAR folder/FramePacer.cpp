@@ -0,0 +1,122 @@
+#include "FramePacer.h"
+#include "Log.h"
+
+using namespace cv;
+using namespace std;
+
+// How often the pacing stats are logged.
+static const int REPORT_SECONDS = 5;
+// waitKey() tends to oversleep by about this much, so stop polling a bit early.
+static const int WAIT_MARGIN_MS = 2;
+
+FrameGrabber::FrameGrabber()
+	: source(0), running(false), skippedCount(0), fresh(false), failed(false)
+{
+}
+
+FrameGrabber::~FrameGrabber()
+{
+	stop();
+}
+
+void FrameGrabber::start(FrameSource *frameSource)
+{
+	if (running)
+		return;
+	source = frameSource;
+	fresh = false;
+	failed = false;
+	running = true;
+	thread = std::thread(&FrameGrabber::loop, this);
+}
+
+void FrameGrabber::stop()
+{
+	if (!running)
+		return;
+	running = false;
+	thread.join(); // at most one frame time, read() returns with the next frame
+}
+
+void FrameGrabber::loop()
+{
+	while (running) {
+		if (!source->read(back)) {
+			lock_guard<mutex> guard(lock);
+			failed = true;
+			arrived.notify_all();
+			break;
+		}
+		{
+			lock_guard<mutex> guard(lock);
+			swap(latest, back);
+			if (fresh)
+				skippedCount++; // nobody took the previous one
+			fresh = true;
+		}
+		arrived.notify_all();
+	}
+}
+
+bool FrameGrabber::take(Frame &out, int timeoutMs)
+{
+	unique_lock<mutex> guard(lock);
+	arrived.wait_for(guard, chrono::milliseconds(timeoutMs), [&] { return fresh || failed; });
+	if (!fresh)
+		return false;
+	// Swap, not copy: out's old buffer goes back to the grabber to be read into.
+	std::swap(out, latest);
+	// If it was a camera's buffer, the camera can have it back right away.
+	latest.hold.reset();
+	fresh = false;
+	return true;
+}
+
+FramePacer::FramePacer(double rate)
+	: missedCount(0), frames(0), missedSinceReport(0), processMs(0)
+{
+	setRate(rate);
+	start = reportStart = Clock::now();
+}
+
+void FramePacer::setRate(double rate)
+{
+	if (rate <= 0)
+		rate = 30; // camera didn't say
+	fps = rate;
+	interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / fps));
+}
+
+void FramePacer::frameStart()
+{
+	start = Clock::now();
+}
+
+int FramePacer::waitTime()
+{
+	Clock::time_point now = Clock::now();
+	Clock::duration spent = now - start;
+	frames++;
+	processMs += chrono::duration<double, milli>(spent).count();
+
+	int wait = 1;
+	if (spent > interval) {
+		missedCount++;
+		missedSinceReport++;
+	}
+	else {
+		long long left = chrono::duration_cast<chrono::milliseconds>(interval - spent).count();
+		wait = max(1, (int)left - WAIT_MARGIN_MS);
+	}
+
+	if (now - reportStart >= chrono::seconds(REPORT_SECONDS)) {
+		double seconds = chrono::duration<double>(now - reportStart).count();
+		LOG_INFO("PACING: {} fps (target {}), {} ms processing, {} missed deadlines",
+			frames / seconds, fps, processMs / frames, missedSinceReport);
+		reportStart = now;
+		frames = 0;
+		missedSinceReport = 0;
+		processMs = 0;
+	}
+	return wait;
+}
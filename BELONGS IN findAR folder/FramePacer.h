@@ -0,0 +1,86 @@
+#ifndef FRAME_PACER
+#define FRAME_PACER
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <opencv2/core/core.hpp>
+
+#include "FrameSource.h"
+
+// Reads a camera on its own thread and keeps only the newest frame ("latest frame wins").
+// The frame loop always works on the freshest capture; frames it was too slow to take are
+// overwritten and counted, they never queue up and add latency.
+class FrameGrabber
+{
+public:
+	FrameGrabber();
+	~FrameGrabber();
+
+	// The source is only read by the grabber thread from now until stop().
+	void start(FrameSource *source);
+	void stop();
+
+	// Swaps the newest frame into out. Waits up to timeoutMs for a frame newer than the
+	// last one taken, returns false if none came or the camera failed.
+	bool take(Frame &out, int timeoutMs);
+
+	// Frames that were replaced before they were taken.
+	int skipped() const { return skippedCount; }
+
+private:
+	void loop();
+
+	FrameSource *source;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<int> skippedCount;
+
+	std::mutex lock;
+	std::condition_variable arrived;
+	Frame latest;		// newest frame, handed out by take()
+	Frame back;			// being read into
+	bool fresh;			// latest hasn't been taken yet
+	bool failed;
+};
+
+// Replaces the fixed waitKey(30) of the frame loop.
+//
+// Deadlines are one frame interval apart, from the camera's frame rate or a display
+// refresh rate. After a frame is shown, waitTime() says how long the loop can poll window
+// events before the next deadline, so a cheap mode runs at the camera's rate instead of
+// sleeping 30 ms on top of its processing time. Frames that take longer than the interval
+// count as missed deadlines; stats are logged every few seconds.
+class FramePacer
+{
+public:
+	explicit FramePacer(double fps);
+
+	void setRate(double fps);
+	double rate() const { return fps; }
+
+	// Call when processing of a new frame starts.
+	void frameStart();
+	// Milliseconds to pass to waitKey(), at least 1 so window events still get handled.
+	int waitTime();
+
+	int missed() const { return missedCount; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	double fps;
+	Clock::duration interval;
+	Clock::time_point start;
+	Clock::time_point reportStart;
+
+	int missedCount;
+	int frames;				// since the last report
+	int missedSinceReport;
+	double processMs;		// summed since the last report
+};
+
+#endif // FRAME_PACER
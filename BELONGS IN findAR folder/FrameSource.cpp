@@ -0,0 +1,132 @@
+#include "FrameSource.h"
+#include "Log.h"
+#ifdef __linux__
+#include "V4l2Capture.h"
+#endif
+
+#include <thread>
+#include <cstdlib>
+
+using namespace cv;
+using namespace std;
+
+Size Frame::size() const
+{
+	if (format == FRAME_NV12)
+		return Size(data.cols, data.rows * 2 / 3);
+	return data.size();
+}
+
+bool VideoCaptureSource::open(int device, int width, int height)
+{
+	if (!cap.open(device))
+		return false;
+	cap.set(CV_CAP_PROP_FRAME_WIDTH, width);
+	cap.set(CV_CAP_PROP_FRAME_HEIGHT, height);
+	return cap.isOpened();
+}
+
+bool VideoCaptureSource::read(Frame& frame)
+{
+	frame.format = FRAME_BGR;
+	frame.hold.reset();
+	return cap.read(frame.data);
+}
+
+double VideoCaptureSource::fps()
+{
+	return cap.get(CV_CAP_PROP_FPS);
+}
+
+bool RawYuvSource::open(const string& path, Size frameSize, FrameFormat frameFormat, double fps)
+{
+	file.open(path.c_str(), ios::in | ios::binary);
+	if (!file)
+		return false;
+	size = frameSize;
+	format = frameFormat;
+	rate = fps > 0 ? fps : 30;
+	next = Clock::now();
+	return true;
+}
+
+bool RawYuvSource::read(Frame& frame)
+{
+	frame.format = format;
+	frame.hold.reset();
+	if (format == FRAME_NV12)
+		frame.data.create(size.height * 3 / 2, size.width, CV_8UC1);
+	else
+		frame.data.create(size.height, size.width, CV_8UC2);
+	streamsize bytes = (streamsize)(frame.data.total() * frame.data.elemSize());
+
+	if (!file.read((char *)frame.data.data, bytes)) {
+		// Start over, like a camera that never stops.
+		file.clear();
+		file.seekg(0);
+		if (!file.read((char *)frame.data.data, bytes)) {
+			LOG_ERROR("Raw video file is shorter than one {}x{} frame", size.width, size.height);
+			return false;
+		}
+	}
+
+	Clock::duration interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / rate));
+	next = max(next + interval, Clock::now() - interval); // no catching up after a stall
+	this_thread::sleep_until(next);
+	return true;
+}
+
+FrameSource *openSource(const string& spec, Size size)
+{
+	size_t at = spec.find('@');
+	if (at != string::npos) {
+		// PATH@WIDTHxHEIGHT[,yuyv|nv12][,FPS]
+		string path = spec.substr(0, at);
+		string rest = spec.substr(at + 1);
+		Size frameSize;
+		FrameFormat format = FRAME_YUYV;
+		double fps = 30;
+		size_t x = rest.find('x');
+		size_t comma = rest.find(',');
+		if (x == string::npos) {
+			LOG_ERROR("Expected PATH@WIDTHxHEIGHT, got: {}", spec);
+			return 0;
+		}
+		frameSize.width = atoi(rest.substr(0, x).c_str());
+		frameSize.height = atoi(rest.substr(x + 1, comma == string::npos ? string::npos : comma - x - 1).c_str());
+		while (comma != string::npos) {
+			size_t end = rest.find(',', comma + 1);
+			string option = rest.substr(comma + 1, end == string::npos ? string::npos : end - comma - 1);
+			if (option == "nv12")
+				format = FRAME_NV12;
+			else if (option == "yuyv")
+				format = FRAME_YUYV;
+			else
+				fps = atof(option.c_str());
+			comma = end;
+		}
+		RawYuvSource *source = new RawYuvSource;
+		if (frameSize.area() <= 0 || !source->open(path, frameSize, format, fps)) {
+			LOG_ERROR("Cannot open raw video file {}", path);
+			delete source;
+			return 0;
+		}
+		return source;
+	}
+
+	int device = atoi(spec.c_str());
+#ifdef __linux__
+	// Straight from the driver's buffers, without converting every frame to BGR.
+	V4l2Capture *camera = new V4l2Capture;
+	if (camera->open("/dev/video" + spec, size.width, size.height))
+		return camera;
+	delete camera;
+	LOG_WARN("V4L2 capture failed for camera {}, trying OpenCV", device);
+#endif
+	VideoCaptureSource *capture = new VideoCaptureSource;
+	if (!capture->open(device, size.width, size.height)) {
+		delete capture;
+		return 0;
+	}
+	return capture;
+}
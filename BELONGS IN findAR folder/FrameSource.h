@@ -0,0 +1,90 @@
+#ifndef FRAME_SOURCE
+#define FRAME_SOURCE
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <chrono>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+// How the pixels of a Frame are laid out.
+enum FrameFormat
+{
+	FRAME_BGR,		// CV_8UC3
+	FRAME_GRAY,		// CV_8UC1
+	FRAME_YUYV,		// CV_8UC2, Y U Y V per two pixels
+	FRAME_NV12,		// CV_8UC1, height Y rows followed by height/2 rows of interleaved U V
+};
+
+// One captured frame as the camera delivered it, not converted to BGR yet.
+//
+// data may be a view straight into a capture driver's buffer. hold keeps that buffer from
+// going back to the driver; once the last copy of the frame is gone (or hold is reset),
+// data must not be used anymore.
+struct Frame
+{
+	Frame() : format(FRAME_BGR) {}
+
+	FrameFormat format;
+	cv::Mat data;
+	std::shared_ptr<void> hold;
+
+	bool empty() const { return data.empty(); }
+	// Size in pixels.
+	cv::Size size() const;
+};
+
+// Something frames can be read from: a camera, a file.
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	// Blocks until the next frame is there. frame may be the previous frame read, so its
+	// memory can be reused. False if the source failed or ended.
+	virtual bool read(Frame& frame) = 0;
+	// Frames per second the source delivers, 0 if unknown.
+	virtual double fps() = 0;
+};
+
+// Any camera or video file OpenCV can open. Frames are BGR.
+class VideoCaptureSource : public FrameSource
+{
+public:
+	bool open(int device, int width, int height);
+	bool read(Frame& frame);
+	double fps();
+
+private:
+	cv::VideoCapture cap;
+};
+
+// Raw YUV frames from a file, e.g. recorded with
+// "ffmpeg -f v4l2 -i /dev/video0 -f rawvideo -pix_fmt yuyv422 out.yuv".
+// Stands in for a camera: frames come at fps and the file starts over at its end.
+class RawYuvSource : public FrameSource
+{
+public:
+	bool open(const std::string& path, cv::Size size, FrameFormat format, double fps);
+	bool read(Frame& frame);
+	double fps() { return rate; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	std::ifstream file;
+	cv::Size size;
+	FrameFormat format;
+	double rate;
+	Clock::time_point next;		// when the next frame is due
+};
+
+// Opens a stream's source. spec is a camera id ("0"), which on Linux is opened through
+// V4L2 and falls back to OpenCV, or a raw YUV file as "PATH@WIDTHxHEIGHT[,yuyv|nv12][,FPS]".
+// size is the resolution asked from cameras. Returns 0 if it can't be opened.
+FrameSource *openSource(const std::string& spec, cv::Size size);
+
+#endif // FRAME_SOURCE
@@ -0,0 +1,182 @@
+#include "LbphFaces.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <opencv2/core/internal.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+CV_INIT_ALGORITHM(LbphFaceModel, "FaceRecognizer.LBPHFast",
+	obj.info()->addParam(obj, "radius", obj.radius);
+	obj.info()->addParam(obj, "neighbors", obj.neighbors);
+	obj.info()->addParam(obj, "grid_x", obj.gridX);
+	obj.info()->addParam(obj, "grid_y", obj.gridY);
+	obj.info()->addParam(obj, "threshold", obj.threshold);
+	obj.info()->addParam(obj, "histograms", obj.histograms, true);
+	obj.info()->addParam(obj, "labels", obj.labels, true));
+
+LbphFaceModel::LbphFaceModel(int radius, int neighbors, int gridX, int gridY, double threshold)
+	: radius(radius), neighbors(neighbors), gridX(gridX), gridY(gridY), threshold(threshold)
+{
+}
+
+Mat LbphFaceModel::histogram(const Mat& image) const
+{
+	Mat src = image;
+	if (src.type() != CV_8UC1)
+		image.convertTo(src, CV_8U);
+	int patterns = 1 << neighbors;
+	Mat result = Mat::zeros(1, gridX * gridY * patterns, CV_32F);
+	int rows = src.rows - 2 * radius;
+	int cols = src.cols - 2 * radius;
+	if (rows < gridY || cols < gridX)
+		return result;
+
+	// Pattern code around every pixel, sampled on a circle with bilinear interpolation
+	// exactly like the stock elbp(), so both models compute the same histograms.
+	Mat codes = Mat::zeros(rows, cols, CV_32S);
+	for (int n = 0; n < neighbors; n++) {
+		float x = (float)(radius * cos(2.0 * CV_PI * n / (float)neighbors));
+		float y = (float)(-radius * sin(2.0 * CV_PI * n / (float)neighbors));
+		int fx = (int)floor(x);
+		int fy = (int)floor(y);
+		int cx = (int)ceil(x);
+		int cy = (int)ceil(y);
+		float ty = y - fy;
+		float tx = x - fx;
+		float w1 = (1 - tx) * (1 - ty);
+		float w2 = tx * (1 - ty);
+		float w3 = (1 - tx) * ty;
+		float w4 = tx * ty;
+		for (int i = radius; i < src.rows - radius; i++) {
+			const uchar *top = src.ptr<uchar>(i + fy);
+			const uchar *bottom = src.ptr<uchar>(i + cy);
+			const uchar *center = src.ptr<uchar>(i);
+			int *code = codes.ptr<int>(i - radius);
+			for (int j = radius; j < src.cols - radius; j++) {
+				float t = w1 * top[j + fx] + w2 * top[j + cx] + w3 * bottom[j + fx] + w4 * bottom[j + cx];
+				code[j - radius] += ((t > center[j]) || (std::abs(t - center[j]) < FLT_EPSILON)) << n;
+			}
+		}
+	}
+
+	// One normalized histogram per grid cell, the cells side by side in one row. Pixels
+	// past the last full cell are left out, like in the stock one.
+	int cellWidth = cols / gridX;
+	int cellHeight = rows / gridY;
+	float cellPixels = (float)(cellWidth * cellHeight);
+	float *hist = result.ptr<float>();
+	for (int gy = 0; gy < gridY; gy++) {
+		for (int gx = 0; gx < gridX; gx++, hist += patterns) {
+			for (int i = gy * cellHeight; i < (gy + 1) * cellHeight; i++) {
+				const int *code = codes.ptr<int>(i);
+				for (int j = gx * cellWidth; j < (gx + 1) * cellWidth; j++)
+					hist[code[j]]++;
+			}
+			for (int b = 0; b < patterns; b++)
+				hist[b] /= cellPixels;
+		}
+	}
+	return result;
+}
+
+void LbphFaceModel::add(InputArrayOfArrays _src, InputArray _labels, ThreadPool& pool, TrainProgress& progress)
+{
+	vector<Mat> src;
+	_src.getMatVector(src);
+	Mat newLabels = _labels.getMat();
+	if (src.empty())
+		CV_Error(CV_StsBadArg, "Empty training data was given. You'll need more than one sample to learn a model.");
+	if ((int)newLabels.total() != (int)src.size())
+		CV_Error(CV_StsBadArg, "The number of samples must equal the number of labels.");
+
+	// Every face's histogram only depends on that face.
+	size_t first = histograms.size();
+	histograms.resize(first + src.size());
+	progress.start("histograms", (int)src.size());
+	pool.parallelFor(0, (int)src.size(), [&](int i) {
+		histograms[first + i] = histogram(src[i]);
+		progress.advance();
+	});
+	for (int i = 0; i < (int)src.size(); i++)
+		labels.push_back(newLabels.at<int>(i));
+}
+
+void LbphFaceModel::train(InputArrayOfArrays src, InputArray newLabels, ThreadPool& pool, TrainProgress& progress)
+{
+	histograms.clear();
+	labels.release();
+	add(src, newLabels, pool, progress);
+}
+
+void LbphFaceModel::train(InputArrayOfArrays src, InputArray newLabels)
+{
+	TrainProgress progress;
+	train(src, newLabels, ThreadPool::shared(), progress);
+}
+
+void LbphFaceModel::update(InputArrayOfArrays src, InputArray newLabels, ThreadPool& pool, TrainProgress& progress)
+{
+	add(src, newLabels, pool, progress);
+}
+
+void LbphFaceModel::update(InputArrayOfArrays src, InputArray newLabels)
+{
+	TrainProgress progress;
+	update(src, newLabels, ThreadPool::shared(), progress);
+}
+
+void LbphFaceModel::predict(InputArray _src, int &label, double &confidence) const
+{
+	if (histograms.empty())
+		CV_Error(CV_StsError, "This LBPH model is not computed yet. Did you call the train method?");
+	Mat query = histogram(_src.getMat());
+	label = -1;
+	confidence = DBL_MAX;
+	for (size_t i = 0; i < histograms.size(); i++) {
+		double distance = compareHist(histograms[i], query, CV_COMP_CHISQR);
+		if (distance < confidence && distance < threshold) {
+			confidence = distance;
+			label = labels.at<int>((int)i);
+		}
+	}
+}
+
+int LbphFaceModel::predict(InputArray src) const
+{
+	int label;
+	double confidence;
+	predict(src, label, confidence);
+	return label;
+}
+
+void LbphFaceModel::save(FileStorage &fs) const
+{
+	fs << "radius" << radius;
+	fs << "neighbors" << neighbors;
+	fs << "grid_x" << gridX;
+	fs << "grid_y" << gridY;
+	fs << "histograms" << "[";
+	for (size_t i = 0; i < histograms.size(); i++)
+		fs << histograms[i];
+	fs << "]";
+	fs << "labels" << labels;
+}
+
+void LbphFaceModel::load(const FileStorage &fs)
+{
+	fs["radius"] >> radius;
+	fs["neighbors"] >> neighbors;
+	fs["grid_x"] >> gridX;
+	fs["grid_y"] >> gridY;
+	histograms.clear();
+	FileNode list = fs["histograms"];
+	for (FileNodeIterator it = list.begin(); it != list.end(); ++it) {
+		Mat hist;
+		*it >> hist;
+		histograms.push_back(hist);
+	}
+	fs["labels"] >> labels;
+}
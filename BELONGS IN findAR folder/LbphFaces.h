@@ -0,0 +1,53 @@
+#ifndef LBPH_FACES
+#define LBPH_FACES
+
+#include <vector>
+#include <cfloat>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+#include "FaceTrainer.h"
+
+// LBPH recognizer used instead of createLBPHFaceRecognizer().
+//
+// Same model as the stock one: the same extended local binary patterns, the same spatial
+// histograms, the same chi-square nearest neighbour with threshold, and save()/load()
+// read and write the stock format, so either can load the other's models. The difference
+// is training: every face's histogram is independent, so train() and update() extract
+// them on the ThreadPool instead of one after another.
+class LbphFaceModel : public cv::FaceRecognizer
+{
+public:
+	LbphFaceModel(int radius = 1, int neighbors = 8, int gridX = 8, int gridY = 8, double threshold = DBL_MAX);
+
+	void train(cv::InputArrayOfArrays src, cv::InputArray labels);
+	void train(cv::InputArrayOfArrays src, cv::InputArray labels, ThreadPool& pool, TrainProgress& progress);
+	// Adds faces to the trained ones.
+	void update(cv::InputArrayOfArrays src, cv::InputArray labels);
+	void update(cv::InputArrayOfArrays src, cv::InputArray labels, ThreadPool& pool, TrainProgress& progress);
+	int predict(cv::InputArray src) const;
+	void predict(cv::InputArray src, int &label, double &confidence) const;
+
+	void save(cv::FileStorage &fs) const;
+	void load(const cv::FileStorage &fs);
+
+	cv::AlgorithmInfo *info() const;
+
+private:
+	// Appends the histograms and labels of src, in parallel on the pool.
+	void add(cv::InputArrayOfArrays src, cv::InputArray labels, ThreadPool& pool, TrainProgress& progress);
+	// Spatial histogram of one face, one row of gridX * gridY * 2^neighbors floats.
+	cv::Mat histogram(const cv::Mat& face) const;
+
+	int radius;
+	int neighbors;
+	int gridX;
+	int gridY;
+	double threshold;
+
+	std::vector<cv::Mat> histograms;
+	cv::Mat labels;		// CV_32S column, labels.at<int>(i) belongs to histograms[i]
+};
+
+#endif // LBPH_FACES
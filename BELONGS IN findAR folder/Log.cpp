@@ -0,0 +1,249 @@
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+// Single producer (the owning thread), single consumer (the writer thread).
+struct LogRing
+{
+	LogRing() : head(0), tail(0), dropped(0), released(false) {}
+	LogRecord records[LOG_RING_SIZE];
+	atomic<unsigned> head;		// next record to write out, only moved by the writer
+	atomic<unsigned> tail;		// next free record, only moved by the owner
+	atomic<unsigned> dropped;
+	atomic<bool> released;		// owner thread has exited
+};
+
+// Rings are never freed: a thread can exit with records still queued, and the
+// writer may still be reading them. Once its thread has exited and the writer has
+// emptied it, a ring goes to the next new thread, so threads that come and go
+// (encoders, trainers) don't each leave one behind.
+static mutex ringsLock;
+static vector<LogRing*> *rings = new vector<LogRing*>;
+
+// Hands the thread's ring back when the thread exits.
+struct LogRingOwner
+{
+	LogRingOwner() : ring(0) {}
+	~LogRingOwner()
+	{
+		if (ring)
+			ring->released.store(true, memory_order_release);
+		ring = 0;
+	}
+	LogRing *ring;
+};
+
+static thread_local LogRingOwner myRing;
+
+// A drained ring of an exited thread, or a new one.
+static LogRing *takeRing()
+{
+	lock_guard<mutex> lock(ringsLock);
+	for (size_t i = 0; i < rings->size(); i++) {
+		LogRing *ring = (*rings)[i];
+		if (ring->released.load(memory_order_acquire) &&
+			ring->head.load(memory_order_acquire) == ring->tail.load(memory_order_relaxed)) {
+			ring->released = false;
+			return ring;
+		}
+	}
+	LogRing *ring = new LogRing;
+	rings->push_back(ring);
+	return ring;
+}
+
+static thread writer;
+static atomic<bool> running(false);
+static const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+static long long nowMicros()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count();
+}
+
+bool LogLimiter::allow(int &suppressedOut)
+{
+	long long now = nowMicros() / 1000000;
+	long long last = second.load(memory_order_relaxed);
+	if (now != last && second.compare_exchange_strong(last, now))
+		count = 0;
+	if (++count > LOG_SITE_RATE) {
+		suppressed++;
+		return false;
+	}
+	suppressedOut = suppressed.exchange(0);
+	return true;
+}
+
+LogRecord *logBegin(int level, const char *fmt, int suppressed)
+{
+	if (!myRing.ring)
+		myRing.ring = takeRing();
+	LogRing *ring = myRing.ring;
+	unsigned t = ring->tail.load(memory_order_relaxed);
+	if (t - ring->head.load(memory_order_acquire) >= (unsigned)LOG_RING_SIZE) {
+		ring->dropped++;
+		return 0;
+	}
+	LogRecord *r = &ring->records[t % LOG_RING_SIZE];
+	r->time = nowMicros();
+	r->fmt = fmt;
+	r->suppressed = suppressed;
+	r->level = (unsigned char)level;
+	r->nargs = 0;
+	r->textUsed = 0;
+	r->spill = 0;
+	r->spillUsed = 0;
+	return r;
+}
+
+// Slow path of logPack() for strings too long for the record's text.
+void logSpill(LogRecord &r, const char *s, size_t length)
+{
+	char *grown = (char *)realloc(r.spill, r.spillUsed + length + 1);
+	if (!grown) {
+		// Out of memory, keep what fits.
+		r.types[r.nargs++] = 's';
+		int room = LOG_TEXT_SIZE - r.textUsed;
+		if (room <= 0)
+			return;
+		size_t n = min(length, (size_t)room - 1);
+		memcpy(r.text + r.textUsed, s, n);
+		r.text[r.textUsed + n] = 0;
+		r.textUsed = (unsigned char)(r.textUsed + n + 1);
+		return;
+	}
+	memcpy(grown + r.spillUsed, s, length + 1);
+	r.spill = grown;
+	r.spillUsed += (unsigned)(length + 1);
+	r.types[r.nargs++] = 'S';
+}
+
+void logCommit()
+{
+	LogRing *ring = myRing.ring;
+	ring->tail.store(ring->tail.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+unsigned logDropped()
+{
+	unsigned total = 0;
+	lock_guard<mutex> lock(ringsLock);
+	for (size_t i = 0; i < rings->size(); i++)
+		total += (*rings)[i]->dropped;
+	return total;
+}
+
+// Replaces each "{}" in the format string with the next argument.
+static void format(const LogRecord &r, string &out)
+{
+	static const char *levelNames[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+	char num[64];
+	sprintf(num, "%lld.%03lld [%s] ", r.time / 1000000, (r.time / 1000) % 1000, levelNames[r.level]);
+	out += num;
+
+	int arg = 0;
+	const char *text = r.text;
+	const char *spill = r.spill;
+	for (const char *c = r.fmt; *c; c++) {
+		if (c[0] != '{' || c[1] != '}') {
+			out += *c;
+			continue;
+		}
+		c++;
+		if (arg >= r.nargs)
+			continue;
+		switch (r.types[arg]) {
+		case 'i':
+			sprintf(num, "%lld", r.values[arg].i);
+			out += num;
+			break;
+		case 'd':
+			sprintf(num, "%g", r.values[arg].d);
+			out += num;
+			break;
+		case 's':
+			if (text < r.text + r.textUsed) {
+				out += text;
+				while (*text++);
+			}
+			break;
+		case 'S':
+			out += spill;
+			while (*spill++);
+			break;
+		}
+		arg++;
+	}
+	if (r.suppressed > 0) {
+		sprintf(num, " (%d more suppressed)", r.suppressed);
+		out += num;
+	}
+	out += '\n';
+}
+
+// Writes out everything queued so far. Returns false if there was nothing.
+static bool drain()
+{
+	vector<LogRing*> snapshot;
+	{
+		lock_guard<mutex> lock(ringsLock);
+		snapshot = *rings;
+	}
+	string out, err;
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		LogRing *ring = snapshot[i];
+		unsigned h = ring->head.load(memory_order_relaxed);
+		unsigned t = ring->tail.load(memory_order_acquire);
+		for (; h != t; h++) {
+			LogRecord &r = ring->records[h % LOG_RING_SIZE];
+			format(r, r.level >= LOG_LEVEL_WARN ? err : out);
+			free(r.spill);
+			r.spill = 0;
+		}
+		ring->head.store(h, memory_order_release);
+	}
+	if (!out.empty()) {
+		fwrite(out.data(), 1, out.size(), stdout);
+		fflush(stdout);
+	}
+	if (!err.empty()) {
+		fwrite(err.data(), 1, err.size(), stderr);
+		fflush(stderr);
+	}
+	return !out.empty() || !err.empty();
+}
+
+static void writerLoop()
+{
+	while (running) {
+		if (!drain())
+			this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	drain();
+}
+
+void logStart()
+{
+	if (running.exchange(true))
+		return;
+	writer = thread(writerLoop);
+	atexit(logStop);
+}
+
+void logStop()
+{
+	if (!running.exchange(false))
+		return;
+	if (writer.joinable())
+		writer.join();
+}
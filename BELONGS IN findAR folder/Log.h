@@ -0,0 +1,151 @@
+#ifndef FINDAR_LOG
+#define FINDAR_LOG
+
+#include <string>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
+
+// Logging that is safe to call from the frame loop.
+//
+// LOG_INFO("mode: {}", mode) only copies the format string pointer and the arguments
+// into a ring buffer owned by the calling thread, it never formats, locks or touches I/O.
+// A background thread started by logStart() empties the rings, formats the records and
+// writes them to stdout (warnings and errors to stderr). If a ring is full the record is
+// dropped and counted instead of waiting.
+//
+// String arguments are copied into the record. Ones that don't fit in its LOG_TEXT_SIZE
+// bytes go to a heap buffer the writer frees, so long paths and error messages cost an
+// allocation but are never cut.
+//
+// Every call site is rate limited to LOG_SITE_RATE records per second, the number of
+// suppressed records is reported with the next one that gets through.
+//
+// LOG_DEBUG calls are compiled out completely (arguments aren't evaluated) unless
+// FINDAR_LOG_DEBUG is defined.
+
+enum LOG_LEVELS{
+	LOG_LEVEL_DEBUG = 0,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_ERROR,
+};
+
+const int LOG_MAX_ARGS = 6;		// "{}" placeholders per record
+const int LOG_TEXT_SIZE = 128;	// room for string arguments per record, the rest spills
+const int LOG_RING_SIZE = 512;	// records per thread
+const int LOG_SITE_RATE = 20;	// records per second per call site
+
+// One log call, stored as-is until the writer thread formats it.
+struct LogRecord
+{
+	long long time;				// microseconds since logStart()
+	const char *fmt;			// must be a string literal
+	int suppressed;				// records of this call site dropped by the rate limiter
+	unsigned char level;
+	unsigned char nargs;
+	unsigned char textUsed;
+	char types[LOG_MAX_ARGS];	// 'i'nteger, 'd'ouble, 's'tring in text or 'S'tring in spill
+	union { long long i; double d; } values[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE];	// string arguments, NUL separated
+	char *spill;				// string arguments that didn't fit in text, malloc'ed
+	unsigned spillUsed;
+};
+
+// Per call site rate limiter, lives in a static inside the LOG_ macros.
+class LogLimiter
+{
+public:
+	LogLimiter() : second(-1), count(0), suppressed(0) {}
+	// Returns false if the site is over its rate. suppressedOut is set to how many
+	// records were dropped since the last one that got through.
+	bool allow(int &suppressedOut);
+private:
+	std::atomic<long long> second;
+	std::atomic<int> count;
+	std::atomic<int> suppressed;
+};
+
+// Starts the writer thread. Logging before this is fine, records wait in the rings.
+void logStart();
+// Writes out everything still queued and stops the writer thread. Also runs at exit.
+void logStop();
+// Records dropped because a ring was full.
+unsigned logDropped();
+
+// Used by the macros below.
+LogRecord *logBegin(int level, const char *fmt, int suppressed);
+void logCommit();
+void logSpill(LogRecord &r, const char *s, size_t length);
+
+inline void logPack(LogRecord &r, const char *s)
+{
+	if (r.nargs >= LOG_MAX_ARGS)
+		return;
+	size_t length = strlen(s);
+	if (length >= (size_t)(LOG_TEXT_SIZE - r.textUsed)) {
+		logSpill(r, s, length);
+		return;
+	}
+	memcpy(r.text + r.textUsed, s, length + 1);
+	r.textUsed = (unsigned char)(r.textUsed + length + 1);
+	r.types[r.nargs++] = 's';
+}
+inline void logPack(LogRecord &r, char *s) { logPack(r, (const char *)s); }
+inline void logPack(LogRecord &r, const std::string &s) { logPack(r, s.c_str()); }
+
+template<typename T>
+inline void logPack(LogRecord &r, T v)
+{
+	static_assert(std::is_arithmetic<T>::value, "unsupported log argument type");
+	if (r.nargs >= LOG_MAX_ARGS)
+		return;
+	if (std::is_floating_point<T>::value) {
+		r.types[r.nargs] = 'd';
+		r.values[r.nargs].d = (double)v;
+	}
+	else {
+		r.types[r.nargs] = 'i';
+		r.values[r.nargs].i = (long long)v;
+	}
+	r.nargs++;
+}
+
+inline void logPackAll(LogRecord &) {}
+
+template<typename T, typename... Rest>
+inline void logPackAll(LogRecord &r, const T &v, const Rest&... rest)
+{
+	logPack(r, v);
+	logPackAll(r, rest...);
+}
+
+template<typename... Args>
+inline void logWrite(int level, int suppressed, const char *fmt, const Args&... args)
+{
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+	LogRecord *r = logBegin(level, fmt, suppressed);
+	if (!r)
+		return; // ring full, counted in logDropped()
+	logPackAll(*r, args...);
+	logCommit();
+}
+
+#define LOG_AT(level, ...) \
+	do { \
+		static LogLimiter log_limiter_; \
+		int log_suppressed_; \
+		if (log_limiter_.allow(log_suppressed_)) \
+			logWrite(level, log_suppressed_, __VA_ARGS__); \
+	} while (0)
+
+#ifdef FINDAR_LOG_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif // FINDAR_LOG
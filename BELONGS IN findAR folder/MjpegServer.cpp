@@ -0,0 +1,268 @@
+#include "MjpegServer.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#define SEND_FLAGS 0
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#define closesocket close
+#define INVALID_SOCKET (-1)
+#define SEND_FLAGS MSG_NOSIGNAL	// a client hanging up shouldn't kill the app with SIGPIPE
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace cv;
+using namespace std;
+
+static const char *BOUNDARY = "findarframe";
+
+// Sends all of data, false if the client went away.
+static bool sendAll(intptr_t socket, const char *data, size_t size)
+{
+	while (size > 0) {
+		int sent = send(socket, data, (int)size, SEND_FLAGS);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+// Waits up to timeoutMs for the socket to become readable.
+static bool readable(intptr_t socket, int timeoutMs)
+{
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(socket, &set);
+	timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+	return select((int)socket + 1, &set, 0, 0, &timeout) > 0;
+}
+
+// Gives up on a send after ms, so a stalled client can't keep stop() waiting.
+static void setSendTimeout(intptr_t socket, int ms)
+{
+#ifdef _WIN32
+	DWORD timeout = ms;
+#else
+	timeval timeout = { ms / 1000, (ms % 1000) * 1000 };
+#endif
+	setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+}
+
+MjpegServer::MjpegServer()
+	: listener(INVALID_SOCKET), port(0), running(false), clients(0), quality(80), scale(1.0),
+	hasPending(false), jpegSeq(0)
+{
+}
+
+MjpegServer::~MjpegServer()
+{
+	stop();
+}
+
+bool MjpegServer::start(int serverPort, const string& address)
+{
+	if (running)
+		return false;
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr(address.c_str());
+	addr.sin_port = htons((unsigned short)serverPort);
+	if (addr.sin_addr.s_addr == INADDR_NONE) {
+		LOG_ERROR("Cannot stream on \"{}\", not an IPv4 address", address);
+		return false;
+	}
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET) {
+		LOG_ERROR("Cannot create socket for streaming");
+		return false;
+	}
+	int yes = 1;
+#ifdef _WIN32
+	// SO_REUSEADDR would let a second findAR take over the port on Windows.
+	setsockopt(listener, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char *)&yes, sizeof(yes));
+#else
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+#endif
+
+	if (::bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+		LOG_ERROR("Cannot listen on {}:{} for streaming", address, serverPort);
+		closesocket(listener);
+		listener = INVALID_SOCKET;
+		return false;
+	}
+	sockaddr_in bound = addr;
+	socklen_t boundSize = sizeof(bound);
+	getsockname(listener, (sockaddr *)&bound, &boundSize);
+	port = ntohs(bound.sin_port);
+	running = true;
+	acceptor = thread(&MjpegServer::acceptLoop, this);
+	encoder = thread(&MjpegServer::encodeLoop, this);
+	if (bound.sin_addr.s_addr == htonl(INADDR_ANY))
+		LOG_WARN("STREAMING on port {} of every network interface, anyone who can reach it can watch", port);
+	else
+		LOG_INFO("STREAMING on http://{}:{}/", inet_ntoa(bound.sin_addr), port);
+	return true;
+}
+
+void MjpegServer::stop()
+{
+	if (!running)
+		return;
+	{
+		// Under the locks, so no thread can miss the wakeup between checking and waiting.
+		lock_guard<mutex> pendingGuard(pendingLock);
+		lock_guard<mutex> jpegGuard(jpegLock);
+		running = false;
+	}
+	pendingReady.notify_all();
+	jpegReady.notify_all();
+	acceptor.join(); // also joins the clients
+	encoder.join();
+	closesocket(listener);
+	listener = INVALID_SOCKET;
+}
+
+void MjpegServer::setQuality(int newQuality)
+{
+	quality = max(0, min(100, newQuality));
+}
+
+void MjpegServer::setScale(double newScale)
+{
+	if (newScale > 0 && newScale <= 1)
+		scale = newScale;
+}
+
+void MjpegServer::publish(const Mat& frame)
+{
+	if (!running || clients == 0)
+		return;
+	{
+		lock_guard<mutex> lock(pendingLock);
+		frame.copyTo(pending); // reuses pending's memory, frame is overwritten next frame
+		hasPending = true;
+	}
+	pendingReady.notify_one();
+}
+
+void MjpegServer::encodeLoop()
+{
+	Mat frame, scaled;
+	vector<int> params(2);
+	params[0] = CV_IMWRITE_JPEG_QUALITY;
+	while (true) {
+		{
+			unique_lock<mutex> lock(pendingLock);
+			pendingReady.wait(lock, [&] { return !running || hasPending; });
+			if (!running)
+				break;
+			// Swap instead of copying, pending gets the old buffer back to fill.
+			swap(frame, pending);
+			hasPending = false;
+		}
+		double s = scale;
+		if (s < 1)
+			cv::resize(frame, scaled, Size(), s, s, INTER_AREA);
+		else
+			scaled = frame;
+		params[1] = quality;
+		shared_ptr<vector<uchar> > data = make_shared<vector<uchar> >();
+		imencode(".jpg", scaled, *data, params);
+		{
+			lock_guard<mutex> lock(jpegLock);
+			jpeg = data;
+			jpegSeq++;
+		}
+		jpegReady.notify_all();
+	}
+}
+
+void MjpegServer::acceptLoop()
+{
+	while (running) {
+		// Clean up clients that hung up.
+		for (list<Client*>::iterator it = clientList.begin(); it != clientList.end();) {
+			if ((*it)->done) {
+				(*it)->thread.join();
+				delete *it;
+				it = clientList.erase(it);
+			}
+			else
+				++it;
+		}
+		// Poll so stop() doesn't have to wait on a blocking accept().
+		if (!readable(listener, 200))
+			continue;
+		intptr_t socket = accept(listener, 0, 0);
+		if (socket == INVALID_SOCKET)
+			continue;
+		setSendTimeout(socket, 2000);
+		Client *client = new Client;
+		client->socket = socket;
+		client->done = false;
+		clients++;
+		client->thread = thread(&MjpegServer::clientLoop, this, client);
+		clientList.push_back(client);
+	}
+	for (list<Client*>::iterator it = clientList.begin(); it != clientList.end(); ++it) {
+		(*it)->thread.join();
+		delete *it;
+	}
+	clientList.clear();
+}
+
+void MjpegServer::clientLoop(Client *client)
+{
+	// Whatever the browser asks for, it gets the stream.
+	char request[1024];
+	if (readable(client->socket, 1000))
+		recv(client->socket, request, sizeof(request), 0);
+
+	char header[256];
+	sprintf(header, "HTTP/1.0 200 OK\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Pragma: no-cache\r\n"
+		"Connection: close\r\n"
+		"Content-Type: multipart/x-mixed-replace; boundary=%s\r\n\r\n", BOUNDARY);
+	bool ok = sendAll(client->socket, header, strlen(header));
+
+	long long sentSeq = 0;
+	while (ok && running) {
+		Jpeg frame;
+		{
+			unique_lock<mutex> lock(jpegLock);
+			// Time out now and then to notice stop().
+			jpegReady.wait_for(lock, chrono::milliseconds(200), [&] { return !running || jpegSeq != sentSeq; });
+			if (jpegSeq == sentSeq)
+				continue;
+			// Newest frame only, anything encoded while we were sending is skipped.
+			frame = jpeg;
+			sentSeq = jpegSeq;
+		}
+		sprintf(header, "--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n", BOUNDARY, (int)frame->size());
+		ok = sendAll(client->socket, header, strlen(header))
+			&& sendAll(client->socket, (const char *)&(*frame)[0], frame->size())
+			&& sendAll(client->socket, "\r\n", 2);
+	}
+	closesocket(client->socket);
+	clients--;
+	client->done = true;
+}
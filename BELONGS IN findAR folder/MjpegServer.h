@@ -0,0 +1,82 @@
+#ifndef MJPEG_SERVER
+#define MJPEG_SERVER
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+
+// Serves the processed frames of one stream as MJPEG over HTTP, so other screens can
+// watch what the headset shows. Open http://HOST:PORT/ in a browser. Anyone who can
+// reach the port can watch, there is no password, so it only listens where it's told.
+//
+// publish() only copies the frame for the encoder thread (and does nothing at all while
+// nobody is connected). The encoder compresses each frame once into a reference counted
+// buffer that every client thread sends from. A client that is slow to send just picks
+// up the newest frame when it's done, so it skips frames instead of holding up the others.
+class MjpegServer
+{
+public:
+	MjpegServer();
+	~MjpegServer();
+
+	// Listens on port of the IPv4 address, e.g. "127.0.0.1" for this machine only or
+	// "0.0.0.0" for every network interface.
+	bool start(int port, const std::string& address);
+	void stop();
+
+	// JPEG quality 0-100 and how much frames are scaled before encoding.
+	void setQuality(int quality);
+	void setScale(double scale);
+
+	int clientCount() const { return clients; }
+
+	// Called from the frame loop with the frame the user saw.
+	void publish(const cv::Mat& frame);
+
+private:
+	typedef std::shared_ptr<const std::vector<uchar> > Jpeg;
+
+	struct Client
+	{
+		intptr_t socket;
+		std::thread thread;
+		std::atomic<bool> done;
+	};
+
+	void acceptLoop();
+	void encodeLoop();
+	void clientLoop(Client *client);
+
+	intptr_t listener;
+	int port;
+	std::atomic<bool> running;
+	std::atomic<int> clients;
+	std::atomic<int> quality;
+	std::atomic<double> scale;
+
+	std::thread acceptor;
+	std::thread encoder;
+	std::list<Client*> clientList;	// only touched by the accept thread and stop()
+
+	// Frame waiting to be encoded, newer frames replace it.
+	std::mutex pendingLock;
+	std::condition_variable pendingReady;
+	cv::Mat pending;
+	bool hasPending;
+
+	// Last encoded frame, shared by all clients.
+	std::mutex jpegLock;
+	std::condition_variable jpegReady;
+	Jpeg jpeg;
+	long long jpegSeq;
+};
+
+#endif // MJPEG_SERVER
@@ -0,0 +1,157 @@
+#include "Recorder.h"
+#include "Log.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+Recorder::Recorder()
+	: recording(false), encoding(false), stopping(false), policy(RECORD_DROP), nth(2), degraded(false), frameCount(0),
+	framesWritten(0), framesDropped(0), framesSkipped(0)
+{
+}
+
+Recorder::~Recorder()
+{
+	stop();
+	if (encoder.joinable())
+		encoder.join();
+}
+
+bool Recorder::start(const string& file, const string& fourcc, double fps, Size frameSize)
+{
+	if (recording)
+		return false;
+	if (encoding) {
+		LOG_WARN("Cannot record to \"{}\" yet, still writing the last recording", file);
+		return false;
+	}
+	if (encoder.joinable())
+		encoder.join(); // done with the last recording, returns right away
+	if (fourcc.size() != 4) {
+		LOG_ERROR("Bad codec \"{}\", needs 4 characters", fourcc);
+		return false;
+	}
+	int codec = CV_FOURCC(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
+	if (!writer.open(file, codec, fps, frameSize, true)) {
+		LOG_ERROR("Cannot open \"{}\" for recording", file);
+		return false;
+	}
+	size = frameSize;
+
+	// All buffers are allocated up front, push() only ever copies into them.
+	buffers.resize(RECORD_QUEUE_SIZE);
+	freeList.clear();
+	queue.clear();
+	for (int i = 0; i < RECORD_QUEUE_SIZE; i++) {
+		buffers[i].create(size, CV_8UC3);
+		freeList.push_back(i);
+	}
+	stopping = false;
+	degraded = false;
+	frameCount = 0;
+	framesWritten = 0;
+	framesDropped = 0;
+	framesSkipped = 0;
+
+	encoding = true;
+	encoder = thread(&Recorder::encoderLoop, this);
+	recording = true;
+	LOG_INFO("RECORDING to {} ({}, {} fps)", file, fourcc, fps);
+	return true;
+}
+
+void Recorder::stop()
+{
+	if (!recording)
+		return;
+	recording = false;
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	ready.notify_one();
+}
+
+void Recorder::setPolicy(int newPolicy, int newNth)
+{
+	lock_guard<mutex> guard(lock);
+	policy = newPolicy;
+	nth = max(2, newNth);
+	degraded = false;
+}
+
+void Recorder::push(const Mat& frame)
+{
+	if (!recording)
+		return;
+
+	int index;
+	{
+		lock_guard<mutex> guard(lock);
+		if (policy == RECORD_EVERY_NTH) {
+			// Start skipping at half full, go back to every frame once mostly drained.
+			int used = RECORD_QUEUE_SIZE - (int)freeList.size();
+			if (used >= RECORD_QUEUE_SIZE / 2)
+				degraded = true;
+			else if (used <= RECORD_QUEUE_SIZE / 4)
+				degraded = false;
+			if (degraded && frameCount++ % nth != 0) {
+				framesSkipped++;
+				return;
+			}
+		}
+		if (freeList.empty()) {
+			framesDropped++;
+			return;
+		}
+		index = freeList.back();
+		freeList.pop_back();
+	}
+
+	// The copy happens outside the lock, the buffer belongs to us until it's queued.
+	Mat &buffer = buffers[index];
+	Mat src = frame;
+	if (src.size() != size) {
+		Mat resized;
+		cv::resize(src, resized, size);
+		src = resized;
+	}
+	if (src.channels() == 1)
+		cvtColor(src, buffer, CV_GRAY2BGR); // B/W and grayscale modes
+	else
+		src.copyTo(buffer);
+
+	{
+		lock_guard<mutex> guard(lock);
+		queue.push_back(index);
+	}
+	ready.notify_one();
+}
+
+void Recorder::encoderLoop()
+{
+	while (true) {
+		int index;
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [&] { return stopping || !queue.empty(); });
+			if (queue.empty())
+				break; // stopping and everything is written
+			index = queue.front();
+			queue.pop_front();
+		}
+		writer.write(buffers[index]);
+		framesWritten++;
+		{
+			lock_guard<mutex> guard(lock);
+			freeList.push_back(index);
+		}
+	}
+	// Closing the file can take a while, so it's done here rather than in stop().
+	writer.release();
+	LOG_INFO("RECORDING stopped: {} written, {} dropped, {} skipped",
+		(int)framesWritten, (int)framesDropped, (int)framesSkipped);
+	encoding = false;
+}
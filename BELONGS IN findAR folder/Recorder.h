@@ -0,0 +1,80 @@
+#ifndef RECORDER
+#define RECORDER
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+// Frames that can wait for the encoder. Each one is a preallocated buffer.
+const int RECORD_QUEUE_SIZE = 8;
+
+// What to do when the encoder can't keep up.
+enum RECORD_POLICY{
+	RECORD_DROP = 0,	// drop frames that don't fit in the queue
+	RECORD_EVERY_NTH,	// once the queue is half full, only keep every Nth frame until it drains
+};
+
+// Records finished frames to a video file without slowing down the live view.
+//
+// push() copies the frame into a free buffer of a fixed pool and queues it, the encoder
+// thread writes queued frames with VideoWriter and hands the buffers back. push() never
+// waits for the encoder: if no buffer is free the frame is dropped and counted. Neither
+// does stop(), the encoder thread writes out the queue and closes the file by itself.
+class Recorder
+{
+public:
+	Recorder();
+	~Recorder();
+
+	// Starts recording to file. fourcc is the codec, e.g. "MJPG" or "XVID". False if the
+	// last recording's file is still being written.
+	bool start(const std::string& file, const std::string& fourcc, double fps, cv::Size size);
+	// Stops taking frames. Returns right away, the queued frames are written and the
+	// file closed on the encoder thread.
+	void stop();
+	bool isRecording() const { return recording; }
+
+	void setPolicy(int policy, int nth);
+
+	// Called from the frame loop with the frame the user saw.
+	void push(const cv::Mat& frame);
+
+	// Counters since start()
+	int written() const { return framesWritten; }
+	int dropped() const { return framesDropped; }	// queue full
+	int skipped() const { return framesSkipped; }	// left out by RECORD_EVERY_NTH
+
+private:
+	void encoderLoop();
+
+	cv::VideoWriter writer;
+	cv::Size size;
+	std::thread encoder;
+	std::atomic<bool> recording;
+	std::atomic<bool> encoding;		// encoder hasn't closed the file yet, true past stop()
+
+	std::mutex lock;				// guards the two lists and stopping
+	std::condition_variable ready;
+	std::vector<cv::Mat> buffers;	// the pool
+	std::vector<int> freeList;		// indices into buffers
+	std::deque<int> queue;			// filled buffers waiting for the encoder
+	bool stopping;
+
+	int policy;
+	int nth;
+	bool degraded;			// RECORD_EVERY_NTH is currently skipping frames
+	int frameCount;
+
+	std::atomic<int> framesWritten;
+	std::atomic<int> framesDropped;
+	std::atomic<int> framesSkipped;
+};
+
+#endif // RECORDER
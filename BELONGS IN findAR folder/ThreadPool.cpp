@@ -0,0 +1,157 @@
+#include "ThreadPool.h"
+#include "Log.h"
+
+#include <chrono>
+#include <exception>
+
+using namespace std;
+
+// Which worker of which pool the current thread is, -1 if it isn't one.
+static thread_local ThreadPool *currentPool = 0;
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(int threads)
+	: nextQueue(0), queued(0), stopping(false)
+{
+	if (threads <= 0)
+		threads = max(1, (int)thread::hardware_concurrency());
+	for (int i = 0; i < threads; i++)
+		queues.push_back(new Queue);
+	for (int i = 0; i < threads; i++)
+		workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+ThreadPool &ThreadPool::shared()
+{
+	// Never destroyed: exit() may be called while workers are still busy.
+	static ThreadPool *pool = new ThreadPool();
+	return *pool;
+}
+
+void ThreadPool::run(TaskGroup &group, Task task)
+{
+	group.pending++;
+	int index = (currentPool == this) ? currentWorker : (int)(nextQueue++ % queues.size());
+	{
+		lock_guard<mutex> lock(queues[index]->lock);
+		Job job = { task, &group };
+		queues[index]->jobs.push_back(job);
+	}
+	{
+		lock_guard<mutex> lock(sleepLock);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup &group)
+{
+	int self = (currentPool == this) ? currentWorker : -1;
+	while (!group.done()) {
+		if (tryRunOne(self))
+			continue;
+		// Nothing left to help with, the group's last tasks are running elsewhere.
+		unique_lock<mutex> lock(sleepLock);
+		finished.wait_for(lock, chrono::milliseconds(1), [&] { return group.done() || queued > 0; });
+	}
+}
+
+void ThreadPool::parallelFor(int begin, int end, const function<void(int)> &body)
+{
+	if (end <= begin)
+		return;
+	// A few chunks per worker keeps the stealing balanced without a task per index.
+	int chunks = min(end - begin, size() * 4);
+	int step = (end - begin + chunks - 1) / chunks;
+	TaskGroup group;
+	for (int start = begin; start < end; start += step) {
+		int stop = min(end, start + step);
+		run(group, [&body, start, stop]() {
+			for (int i = start; i < stop; i++)
+				body(i);
+		});
+	}
+	wait(group);
+}
+
+void ThreadPool::workerLoop(int index)
+{
+	currentPool = this;
+	currentWorker = index;
+	while (true) {
+		if (tryRunOne(index))
+			continue;
+		unique_lock<mutex> lock(sleepLock);
+		wake.wait(lock, [&] { return stopping || queued > 0; });
+		if (stopping && queued == 0)
+			break;
+	}
+}
+
+bool ThreadPool::tryRunOne(int self)
+{
+	Job job;
+	if ((self >= 0 && popOwn(self, job)) || steal(self, job)) {
+		queued--;
+		execute(job);
+		return true;
+	}
+	return false;
+}
+
+bool ThreadPool::popOwn(int index, Job &job)
+{
+	Queue &q = *queues[index];
+	lock_guard<mutex> lock(q.lock);
+	if (q.jobs.empty())
+		return false;
+	job = q.jobs.back();
+	q.jobs.pop_back();
+	return true;
+}
+
+bool ThreadPool::steal(int self, Job &job)
+{
+	int n = (int)queues.size();
+	int first = (self >= 0) ? self + 1 : (int)(nextQueue % n);
+	for (int k = 0; k < n; k++) {
+		int index = (first + k) % n;
+		if (index == self)
+			continue;
+		Queue &q = *queues[index];
+		lock_guard<mutex> lock(q.lock);
+		if (q.jobs.empty())
+			continue;
+		job = q.jobs.front();
+		q.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::execute(Job &job)
+{
+	try {
+		job.task();
+	}
+	catch (exception& e) {
+		LOG_ERROR("Task failed: {}", e.what());
+	}
+	if (--job.group->pending == 0) {
+		lock_guard<mutex> lock(sleepLock);
+		finished.notify_all();
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Tracks a set of tasks so a caller can wait for all of them.
+class TaskGroup
+{
+public:
+	TaskGroup() : pending(0) {}
+	bool done() const { return pending == 0; }
+private:
+	friend class ThreadPool;
+	std::atomic<int> pending;
+};
+
+// Work-stealing thread pool shared by everything in the app that runs in parallel
+// (per-stream filters, batched face recognition), so one busy stream can use the
+// cores the others leave idle.
+//
+// Each worker has its own task queue. Tasks submitted from a worker go on that
+// worker's queue (newest first, cache friendly), tasks from other threads are spread
+// round-robin. Idle workers steal the oldest task of another queue. wait() runs queued
+// tasks on the calling thread instead of just sleeping, so a task can submit sub-tasks
+// and wait for them without tying up a worker.
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	// threads = 0 uses one worker per core.
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	// The pool used by the app.
+	static ThreadPool &shared();
+
+	int size() const { return (int)workers.size(); }
+
+	void run(TaskGroup &group, Task task);
+	// Returns once every task of the group has finished, helping out meanwhile.
+	void wait(TaskGroup &group);
+	// Calls body(i) for i in [begin, end) on the pool and waits for it.
+	void parallelFor(int begin, int end, const std::function<void(int)> &body);
+
+private:
+	struct Job
+	{
+		Task task;
+		TaskGroup *group;
+	};
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	void workerLoop(int index);
+	bool tryRunOne(int self);
+	bool popOwn(int index, Job &job);
+	bool steal(int self, Job &job);
+	void execute(Job &job);
+
+	std::vector<std::thread> workers;
+	std::vector<Queue*> queues;
+	std::atomic<unsigned> nextQueue;
+	std::atomic<int> queued;		// jobs sitting in queues, for sleeping workers
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::condition_variable finished;	// signalled when a group drops to zero
+	bool stopping;
+};
+
+#endif // THREAD_POOL
@@ -0,0 +1,234 @@
+#ifdef __linux__
+
+#include "V4l2Capture.h"
+#include "Log.h"
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+using namespace cv;
+using namespace std;
+
+// A camera that hasn't delivered a frame in this long is considered gone.
+static const int READ_TIMEOUT_MS = 2000;
+
+// ioctl() that retries when a signal interrupts it.
+static int xioctl(int fd, unsigned long request, void *arg)
+{
+	int result;
+	do {
+		result = ioctl(fd, request, arg);
+	} while (result == -1 && errno == EINTR);
+	return result;
+}
+
+V4l2Capture::Device::~Device()
+{
+	for (size_t i = 0; i < starts.size(); i++)
+		munmap(starts[i], lengths[i]);
+	if (fd >= 0)
+		::close(fd);
+}
+
+void V4l2Capture::Device::requeue(unsigned int index)
+{
+	// After close() the driver has all buffers back already.
+	if (!streaming)
+		return;
+	v4l2_buffer buf;
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = index;
+	if (xioctl(fd, VIDIOC_QBUF, &buf) == -1)
+		LOG_WARN("V4L2: cannot requeue buffer {}: {}", index, strerror(errno));
+}
+
+V4l2Capture::V4l2Capture()
+	: pixelFormat(0), width(0), height(0), stride(0), rate(0)
+{
+}
+
+V4l2Capture::~V4l2Capture()
+{
+	close();
+}
+
+bool V4l2Capture::open(const string& path, int requestedWidth, int requestedHeight, double fps)
+{
+	close();
+	shared_ptr<Device> dev = make_shared<Device>();
+	dev->fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+	if (dev->fd < 0)
+		return false;
+
+	v4l2_capability caps;
+	memset(&caps, 0, sizeof(caps));
+	if (xioctl(dev->fd, VIDIOC_QUERYCAP, &caps) == -1)
+		return false;
+	uint32_t deviceCaps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+	if (!(deviceCaps & V4L2_CAP_VIDEO_CAPTURE) || !(deviceCaps & V4L2_CAP_STREAMING)) {
+		LOG_WARN("V4L2: {} can't stream video", path);
+		return false;
+	}
+
+	// The driver answers with the closest format it has, take the first one that it kept.
+	const uint32_t formats[] = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_MJPEG };
+	v4l2_format fmt;
+	bool found = false;
+	for (int i = 0; i < 3 && !found; i++) {
+		memset(&fmt, 0, sizeof(fmt));
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		fmt.fmt.pix.width = requestedWidth;
+		fmt.fmt.pix.height = requestedHeight;
+		fmt.fmt.pix.pixelformat = formats[i];
+		fmt.fmt.pix.field = V4L2_FIELD_NONE;
+		found = xioctl(dev->fd, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == formats[i];
+	}
+	if (!found) {
+		LOG_WARN("V4L2: {} has neither YUYV, NV12 nor MJPEG", path);
+		return false;
+	}
+	pixelFormat = fmt.fmt.pix.pixelformat;
+	width = fmt.fmt.pix.width;
+	height = fmt.fmt.pix.height;
+	stride = fmt.fmt.pix.bytesperline;
+
+	v4l2_streamparm parm;
+	memset(&parm, 0, sizeof(parm));
+	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (fps > 0) {
+		parm.parm.capture.timeperframe.numerator = 1000;
+		parm.parm.capture.timeperframe.denominator = (uint32_t)(fps * 1000);
+		xioctl(dev->fd, VIDIOC_S_PARM, &parm);
+	}
+	rate = 0;
+	if (xioctl(dev->fd, VIDIOC_G_PARM, &parm) == 0 && parm.parm.capture.timeperframe.numerator > 0)
+		rate = (double)parm.parm.capture.timeperframe.denominator / parm.parm.capture.timeperframe.numerator;
+
+	v4l2_requestbuffers req;
+	memset(&req, 0, sizeof(req));
+	req.count = V4L2_BUFFERS;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (xioctl(dev->fd, VIDIOC_REQBUFS, &req) == -1 || req.count < 3) {
+		LOG_WARN("V4L2: {} has no memory mapped buffers", path);
+		return false;
+	}
+	for (unsigned int i = 0; i < req.count; i++) {
+		v4l2_buffer buf;
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = i;
+		if (xioctl(dev->fd, VIDIOC_QUERYBUF, &buf) == -1)
+			return false;
+		void *start = mmap(0, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, buf.m.offset);
+		if (start == MAP_FAILED)
+			return false;
+		dev->starts.push_back(start);
+		dev->lengths.push_back(buf.length);
+		if (xioctl(dev->fd, VIDIOC_QBUF, &buf) == -1)
+			return false;
+	}
+
+	v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (xioctl(dev->fd, VIDIOC_STREAMON, &type) == -1)
+		return false;
+	dev->streaming = true;
+	device = dev;
+
+	char name[5] = { (char)(pixelFormat & 0xff), (char)((pixelFormat >> 8) & 0xff),
+		(char)((pixelFormat >> 16) & 0xff), (char)((pixelFormat >> 24) & 0xff), 0 };
+	LOG_INFO("V4L2: {} streaming {} {}x{} at {} fps", path, name, width, height, rate);
+	return true;
+}
+
+void V4l2Capture::close()
+{
+	if (!device)
+		return;
+	v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	xioctl(device->fd, VIDIOC_STREAMOFF, &type);
+	device->streaming = false;
+	// Unmapped once the last frame holding a buffer is gone.
+	device.reset();
+}
+
+bool V4l2Capture::dequeue(unsigned int& index, unsigned int& bytes)
+{
+	v4l2_buffer buf;
+	while (true) {
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		if (xioctl(device->fd, VIDIOC_DQBUF, &buf) == 0)
+			break;
+		if (errno != EAGAIN) {
+			LOG_ERROR("V4L2: cannot dequeue a frame: {}", strerror(errno));
+			return false;
+		}
+		pollfd ready = { device->fd, POLLIN, 0 };
+		if (poll(&ready, 1, READ_TIMEOUT_MS) <= 0) {
+			LOG_ERROR("V4L2: no frame for {} ms", READ_TIMEOUT_MS);
+			return false;
+		}
+	}
+	index = buf.index;
+	bytes = buf.bytesused;
+	return true;
+}
+
+bool V4l2Capture::read(Frame& frame)
+{
+	if (!device)
+		return false;
+	// The buffer the frame used to view goes back first, the driver may need it.
+	frame.hold.reset();
+
+	unsigned int index, bytes;
+	if (pixelFormat != V4L2_PIX_FMT_MJPEG) {
+		if (!dequeue(index, bytes))
+			return false;
+		shared_ptr<Device> dev = device;
+		frame.hold = shared_ptr<void>(dev->starts[index], [dev, index](void *) { dev->requeue(index); });
+		if (pixelFormat == V4L2_PIX_FMT_YUYV) {
+			frame.format = FRAME_YUYV;
+			frame.data = Mat(height, width, CV_8UC2, dev->starts[index], stride);
+		}
+		else {
+			frame.format = FRAME_NV12;
+			frame.data = Mat(height * 3 / 2, width, CV_8UC1, dev->starts[index], stride);
+		}
+		return true;
+	}
+
+	while (true) {
+		if (!dequeue(index, bytes))
+			return false;
+		// Skip to the newest JPEG, decoding the older ones would only add latency.
+		unsigned int newer, newerBytes;
+		pollfd ready = { device->fd, POLLIN, 0 };
+		while (poll(&ready, 1, 0) > 0 && dequeue(newer, newerBytes)) {
+			device->requeue(index);
+			index = newer;
+			bytes = newerBytes;
+		}
+		// Decoded straight from the driver's buffer into the frame's own memory.
+		Mat jpeg(1, (int)bytes, CV_8UC1, device->starts[index]);
+		frame.format = FRAME_BGR;
+		imdecode(jpeg, CV_LOAD_IMAGE_COLOR, &frame.data);
+		device->requeue(index);
+		if (!frame.data.empty())
+			return true;
+		LOG_WARN("V4L2: dropped a corrupt JPEG frame");
+	}
+}
+
+#endif // __linux__
@@ -0,0 +1,66 @@
+#ifndef V4L2_CAPTURE
+#define V4L2_CAPTURE
+
+#ifdef __linux__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+#include "FrameSource.h"
+
+// Driver buffers mapped for a camera. Frames can hold one while the driver streams.
+const int V4L2_BUFFERS = 6;
+
+// Reads a Linux camera through V4L2 directly instead of through VideoCapture.
+//
+// The driver fills buffers that are mapped into our memory. YUYV and NV12 frames are
+// handed out as views of those buffers, nothing is copied or converted: FrameCache reads
+// the Y plane for grayscale and only makes BGR when something asks for it. A frame's hold
+// gives its buffer back to the driver. MJPEG cameras are decoded to BGR on the thread that
+// reads the camera (the FrameGrabber's), never on the frame loop; JPEGs that queued up
+// while decoding are skipped without being decoded.
+class V4l2Capture : public FrameSource
+{
+public:
+	V4l2Capture();
+	~V4l2Capture();
+
+	// Opens e.g. /dev/video0 and starts streaming at about width x height. YUYV is used
+	// if the camera has it, then NV12, then MJPEG.
+	bool open(const std::string& device, int width, int height, double fps = 0);
+	void close();
+
+	bool read(Frame& frame);
+	double fps() { return rate; }
+
+private:
+	// Outlives the capture while frames still hold its buffers.
+	struct Device
+	{
+		Device() : fd(-1), streaming(false) {}
+		~Device();
+		void requeue(unsigned int index);
+
+		int fd;
+		std::vector<void *> starts;
+		std::vector<size_t> lengths;
+		std::atomic<bool> streaming;
+	};
+
+	// Next filled buffer, false if the camera stopped delivering.
+	bool dequeue(unsigned int& index, unsigned int& bytes);
+
+	std::shared_ptr<Device> device;
+	uint32_t pixelFormat;
+	int width;
+	int height;
+	int stride;		// bytes per row
+	double rate;
+};
+
+#endif // __linux__
+
+#endif // V4L2_CAPTURE
@@ -28,9 +28,23 @@
 #include <iostream>	// Used for C++ cout print statements
 #include <fstream>
 #include <sstream>
+#include <ctime>
 
 // User libraries included here.
 #include "HSVColorWheel.h"
+#include "FaceModel.h"
+#include "FaceBatch.h"
+#include "Log.h"
+#include "ThreadPool.h"
+#include "Recorder.h"
+#include "MjpegServer.h"
+#include "FramePacer.h"
+#include "EigenFaces.h"
+#include "FaceTrainer.h"
+#include "Foveator.h"
+#include "FrameCache.h"
+#include "FrameBus.h"
+#include "FaceWorker.h"
 
 // Include OpenCV libraries
 #include <opencv2/opencv.hpp>
@@ -51,25 +65,51 @@
 using namespace cv;
 using namespace std;
 
+struct Stream;
+
 /// Function Prototypes
 // This function is automatically called whenever the user clicks the mouse in the window.
 void mouseEvent(int ievent, int x, int y, int flags, void* param);
 // Used for creating the red outlines.
 void trackFilteredObject(Mat threshold, Mat &cameraFeed);
 // Calculates image for COLOR_PICK
-Mat calcColorPick(Mat imgOriginal);
+Mat calcColorPick(Stream &stream, FrameCache &frame);
 // Calculates image for OUTLINE
-Mat calcOutline(Mat imgOriginal);
+Mat calcOutline(Stream &stream, FrameCache &frame);
+// Calculates images for GRAY, BW, SEPIA and HUE
+Mat calcGray(Stream &stream, FrameCache &frame);
+Mat calcBW(Stream &stream, FrameCache &frame);
+Mat calcSepia(Stream &stream, FrameCache &frame);
+Mat calcHue(Stream &stream, FrameCache &frame);
+// Runs one of the filters above on the stream's frame, foveated if turned on. luma for
+// filters that only use gray(), they never make a YUV frame convert to BGR.
+Mat filtered(Stream &stream, Mat (*filter)(Stream &, FrameCache &), bool luma = false);
+// Finds the faces in the stream's grayscale frame, foveated if turned on
+void detectFaces(Stream &stream, vector<Rect> &faces);
 // Used for facial rec data
 static void read_csv(const string& filename, vector<Mat>& images, vector<int>& labels, char separator = ';');
+// Hands the frame to the stream's face workers, takes their newest result
+bool workerFaces(Stream &stream, FrameCache &frame);
 // Calculates facial rec frame
-Mat calcFace(Mat imgOriginal, CascadeClassifier haar_cascade, int im_width, int im_height, Ptr<FaceRecognizer> model);
+Mat calcFace(Stream &stream, FrameCache &frame, int im_width, int im_height, const Ptr<FaceRecognizer> &model);
 // Some curl function
 size_t curl_write(void *ptr, size_t size, size_t nmemb, void *stream);
 // Handling Pebble app string
-int getMode(std::string buf);
+int getMode(Stream &stream, std::string buf);
+// Sends a Pebble app string to the stream(s) it is meant for
+void handleCommand(std::string buf);
+// True if any stream is in this mode
+bool anyStreamIn(int mode);
 // facial detect frame
-Mat calcFaceDetect(Mat imgOriginal, CascadeClassifier haar_cascade, int im_width, int im_height, Ptr<FaceRecognizer> model);
+Mat calcFaceDetect(Stream &stream, FrameCache &frame);
+// Runs the stream's current mode on its latest frame
+void processFrame(Stream &stream, int im_width, int im_height);
+// Handles the "record ..." commands
+void recordCommand(Stream &stream, std::string buf);
+// Handles the "mjpeg ..." commands
+void mjpegCommand(Stream &stream, std::string buf);
+// Handles the "fovea ..." commands
+void foveaCommand(Stream &stream, std::string buf);
 
 /* ADDED FOR OBJECT DETECTION: read an image of object, detect presence of that object in live video feed.
 // Calculates image for Object Detection by SURF
@@ -109,42 +149,74 @@ enum MODES{
 	FACE_DETECT,
 };
 
-int last_mode = 1;
+// One camera feed. Every stream has its own mode, color pick values and matrices
+// for calculations, so streams can be processed at the same time on the thread pool.
+struct Stream
+{
+	Stream() : device(0), source(0), fps(0), mode(ORIGINAL), last_mode(ORIGINAL),
+		hue(90), saturation(240), brightness(200), hueUpdate(10), bounce(false),
+		bus(0), frameNumber(0) {}
+	~Stream() { grabber.stop(); delete source; delete bus; }
 
-char *colorWheelTitle = "HSV Color Wheel";	// title of the window
+	int device;
+	string window;			// title of the output window
+	FrameSource *source;	// camera or raw video file, see openSource()
+	double fps;				// the camera's frame rate
+	FrameGrabber grabber;	// reads source on its own thread, keeps the newest frame
+	CascadeClassifier haar_cascade;	// detectMultiScale() isn't thread safe, so one per stream
+
+	int mode;
+	int last_mode;
+
+	int hue;			// This variable is adjusted by the user's trackbar at runtime.
+	int saturation;		//		"
+	int brightness;		//		"
+
+	int hueUpdate;
+	bool bounce;
 
-int framewidth = 680;
-int frameheight = 480;
+	Frame imgOriginal;		// as the camera delivered it, may be YUV
+	Mat img_final;
+	FrameCache frame;		// gray, HSV, ... of imgOriginal, computed once when first needed
+
+	// Matrices for calculations
+	Mat img_gray;
+	Mat imgThresholded;
+	Mat img_invertThreshold;
+	Mat img_grayRGB;
+	Mat img_obj;
+	Mat dst, detected_edges;
+	vector<Mat> hsv_planes;
+	Mat face_batch;					// every face of the frame, one per row
+	vector<FaceResult> face_results;
+
+	Recorder recorder;				// records img_final when turned on
+	MjpegServer server;				// serves img_final to browsers
+	Foveator fovea;					// full quality only around the fovea when turned on
+
+	string busName;					// face workers get the frames on this bus when set
+	FrameBus *bus;					// created with the first frame in FACE mode
+	uint64_t frameNumber;			// of the frames published on bus
+};
 
-int hue = 90;			// This variable is adjusted by the user's trackbar at runtime.
-int saturation = 240;	//		"
-int brightness = 200;	//		"
+vector<Stream*> streams;
+int selected = 0;	// stream the color wheel shows and edits, last one addressed with "cam N:"
+
+char *colorWheelTitle = "HSV Color Wheel";	// title of the window
 
 int mouseX = -1;	// Position in the window that a user clicked the mouse button.
 int mouseY = -1;	//		"
 
-// Matrices for calculations
-Mat img_gray;
-Mat imgHSV;
-Mat imgThresholded;
-Mat img_invertThreshold;
-Mat img_grayRGB;
-Mat img_obj;
-
-Mat dst, detected_edges;
 Mat kern = (cv::Mat_<float>(4, 4) << 0.272, 0.534, 0.131, 0,
 	0.349, 0.686, 0.168, 0,
 	0.393, 0.769, 0.189, 0,
 	0, 0, 0, 1);
 
-vector<Mat> hsv_planes;
 int edgeThresh = 1;
 int lowThreshold = 33;
 int const max_lowThreshold = 100;
-int ratio = 3;
+int cannyRatio = 3;	// "ratio" clashes with std::ratio, which <thread> pulls in
 int kernel_size = 3;
-int hueUpdate = 10;
-bool bounce = false;
 
 // HTML String
 std::string buffer;
@@ -157,17 +229,34 @@ bool start = false;
 bool nextNum = false;
 bool next2Num = false;
 
-int mode = 1;
 int counter = 0;
 
+// Codec for new recordings, changed with "record codec:XXXX"
+std::string record_codec = "MJPG";
+
+// Port the first camera is served on over HTTP, the next ones count up from it.
+// Off (0) unless set with "--mjpeg=PORT".
+int mjpeg_port = 0;
+// Address the MJPEG servers listen on, this machine only unless set with "--mjpeg-bind=ADDRESS".
+std::string mjpeg_address = "127.0.0.1";
+
+// Display deadlines follow the first camera's frame rate unless set with "pace:FPS".
+FramePacer *pacer = 0;
+double pace_fps = 0;	// rate set with "pace:FPS", 0 for the camera's
+
+// Face recognition model, can be extended at runtime with "enroll:NAME"
+FaceModel *faceModel = 0;
+
 int main(int argc, char** argv)
 {
+	// Console output goes through a background thread so the frame loop never blocks on it
+	logStart();
+
 	// START TRAINING
-	std::cout << "START TRAINING" << endl;
+	LOG_INFO("START TRAINING");
 	// Get the path to your CascadeClassifier and CSV:
 	string fn_haar = "C:/Users/Alvin/Desktop/opencv/sources/data/haarcascades/haarcascade_frontalface_default.xml";
 	string fn_csv = "C:/Users/Alvin/Desktop/findAR/facescsv.txt"; // Change to work
-	int deviceId = 0;
 	// These vectors hold the images and corresponding labels:
 	vector<Mat> images;
 	vector<int> labels;
@@ -176,7 +265,7 @@ int main(int argc, char** argv)
 		read_csv(fn_csv, images, labels);
 	}
 	catch (cv::Exception& e) {
-		cerr << "Error opening file \"" << fn_csv << "\". Reason: " << e.msg << endl;
+		LOG_ERROR("Error opening file \"{}\". Reason: {}", fn_csv, e.msg);
 		// nothing more we can do
 		exit(1);
 	}
@@ -185,6 +274,37 @@ int main(int argc, char** argv)
 	// size AND we need to reshape incoming faces to this size:
 	int im_width = images[0].cols;
 	int im_height = images[0].rows;
+	// "findAR --eigen-check" compares our Eigenfaces against OpenCV's on the faces and exits,
+	// "findAR --train-bench" times training on a synthetic gallery the size of the faces.
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--eigen-check") {
+			compareWithStock(images, labels);
+			return 0;
+		}
+		if (string(argv[i]) == "--train-bench") {
+			benchmarkTraining(Size(im_width, im_height), 4000);
+			return 0;
+		}
+	}
+	// "findAR --face-workers" hands the face recognition of every camera to worker processes,
+	// started as "findAR --face-worker=N" for camera N (counting from 0). See FrameBus.h.
+	bool faceWorkers = false;
+	int faceWorker = -1;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--face-workers")
+			faceWorkers = true;
+		else if (arg.compare(0, 14, "--face-worker=") == 0)
+			faceWorker = atoi(arg.substr(14).c_str());
+	}
+	// "findAR --mjpeg=8080" serves the cameras over HTTP, see MjpegServer.h.
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 8, "--mjpeg=") == 0)
+			mjpeg_port = atoi(arg.substr(8).c_str());
+		else if (arg.compare(0, 13, "--mjpeg-bind=") == 0)
+			mjpeg_address = arg.substr(13);
+	}
 	// The following lines create an LBPH model for
 	// face recognition and train it with the images and
 	// labels read from the given CSV file.
@@ -207,49 +327,99 @@ int main(int argc, char** argv)
 	//
 	//      cv::createLBPHFaceRecognizer(1,8,8,8,123.0)
 	//
-	Ptr<FaceRecognizer> model = createEigenFaceRecognizer();
-	model->train(images, labels);
-	// That's it for learning the Face Recognition model. You now
-	// need to create the classifier for the task of Face Detection.
-	// We are going to use the haar cascade you have specified in the
-	// command line arguments:
+	// LbphFaceModel takes the same arguments and trains on all cores, see LbphFaces.h.
 	//
-	CascadeClassifier haar_cascade;
-	haar_cascade.load(fn_haar);
-	std::cout << "END TRAINING" << endl;
+	// Instead of createEigenFaceRecognizer(), EigenFaceModel keeps fewer components and
+	// predicts with SIMD, see EigenFaces.h.
+	Ptr<FaceRecognizer> model = new EigenFaceModel();
+	trainFaces(*model, images, labels);
+	// Hand the model over to FaceModel so new people can be enrolled while running.
+	// Labels in facescsv.txt index into this list.
+	vector<string> names;
+	names.push_back("Yuki");
+	names.push_back("Alvin");
+	names.push_back("Ethan");
+	names.push_back("Mike");
+	faceModel = new FaceModel([]() { return Ptr<FaceRecognizer>(new EigenFaceModel()); }, model, images, labels, names);
+	// That's it for learning the Face Recognition model. The classifier
+	// for the task of Face Detection is loaded per stream below.
+	LOG_INFO("END TRAINING");
 	// END TRAINING
 
+	if (faceWorker >= 0)
+		return runFaceWorker(faceBusName(faceWorker), fn_haar, model, Size(im_width, im_height));
+
 	// Create a GUI window
 	cvNamedWindow(colorWheelTitle, 1);
-	
-	VideoCapture cap(0); //capture the video from webcam
-    
-	cap.set(CV_CAP_PROP_FRAME_WIDTH, 640);
-	cap.set(CV_CAP_PROP_FRAME_HEIGHT, 480);
-    
-	frameheight = int(cap.get(3));
-	framewidth = int(cap.get(4));
-    
-	if (!cap.isOpened())  // if not success, exit program
+
+	// Streams come from the command line as camera ids with an optional starting
+	// mode, e.g. "findAR 0 1:outline". Without arguments camera 0 is used. A raw YUV
+	// file can stand in for a camera: "findAR clip.yuv@640x480,yuyv,30:gray".
+	vector<string> sources;
+	for (int i = 1; i < argc; i++)
+		if (argv[i][0] != '-')
+			sources.push_back(argv[i]);
+	if (sources.empty())
+		sources.push_back("0");
+
+	for (int i = 0; i < sources.size(); i++)
 	{
-		std::cout << "Cannot open the web cam" << endl;
-		return -1;
+		Stream *stream = new Stream;
+		// A file's path may contain ':' itself, the mode comes after its size.
+		size_t at = sources[i].find('@');
+		size_t colon = sources[i].find(':', at == string::npos ? 0 : at);
+		stream->device = atoi(sources[i].substr(0, colon).c_str());
+		stream->window = "Final";
+		if (sources.size() > 1)
+			stream->window += " " + sources[i].substr(0, colon);
+		stream->haar_cascade.load(fn_haar);
+		if (faceWorkers)
+			stream->busName = faceBusName(i);
+
+		stream->source = openSource(sources[i].substr(0, colon), Size(640, 480)); //capture the video from webcam
+
+		if (!stream->source)  // if not success, exit program
+		{
+			LOG_ERROR("Cannot open the web cam {}", sources[i].substr(0, colon));
+			return -1;
+		}
+		if (colon != string::npos)
+			getMode(*stream, sources[i].substr(colon + 1));
+		if (mjpeg_port)
+			stream->server.start(mjpeg_port + i, mjpeg_address);
+		streams.push_back(stream);
 	}
-    
-	Mat imgOriginal;
-	Mat img_final;
 
-	while (true)
+	// From here on the cameras are only read by their grabber threads.
+	for (int i = 0; i < streams.size(); i++)
 	{
-		bool bSuccess = cap.read(imgOriginal); // read a new frame from video
+		streams[i]->fps = streams[i]->source->fps();
+		streams[i]->grabber.start(streams[i]->source);
+	}
+	pacer = new FramePacer(pace_fps > 0 ? pace_fps : streams[0]->fps);
+
+	// Filters of all streams share one pool, a stream in an expensive mode
+	// gets the cores the cheap ones don't need.
+	ThreadPool &pool = ThreadPool::shared();
+	bool running = true;
 
-		if (!bSuccess) //if not success, break loop
+	while (running)
+	{
+		// Always the freshest frame of every camera, older ones are skipped.
+		for (int i = 0; i < streams.size(); i++)
 		{
-			std::cout << "Cannot read a frame from video stream" << endl;
-			break;
+			if (!streams[i]->grabber.take(streams[i]->imgOriginal, 1000)) //if not success, break loop
+			{
+				LOG_ERROR("Cannot read a frame from video stream {}", streams[i]->device);
+				running = false;
+			}
 		}
+		if (!running)
+			break;
+		pacer->frameStart();
+
 		counter++;
-		if (counter == 100 || (mode == FACE && counter >= 10) || (mode == COLOR_PICK && counter >= 20)) //delay to reduce latency
+		if (counter == 100 || (anyStreamIn(FACE) && counter >= 10) || (anyStreamIn(COLOR_PICK) && counter >= 20)) //delay to reduce latency
 		{
 			//curl request from web server
 			CURL *curl = curl_easy_init();
@@ -260,91 +430,144 @@ int main(int argc, char** argv)
 			counter = 0;
 		}
 
-		mode = getMode(buffer); //get mode from pebble
+		handleCommand(buffer); //get mode from pebble
 
-		if (!mode)
+		TaskGroup frame;
+		for (int i = 0; i < streams.size(); i++)
 		{
-			std::cout << "Cannot get mode from pebble" << endl;
-			break;
+			Stream *stream = streams[i];
+			if (!stream->mode)
+			{
+				LOG_ERROR("Cannot get mode from pebble");
+				running = false;
+				break;
+			}
+			pool.run(frame, [stream, im_width, im_height]() { processFrame(*stream, im_width, im_height); });
 		}
-
-		switch (mode)
-		{
-		case ORIGINAL:
-			img_final = imgOriginal;
-			last_mode = ORIGINAL;
-			break;
-		case OUTLINE:
-			img_final = calcOutline(imgOriginal);
-			last_mode = OUTLINE;
-			break;
-		case GRAY:
-			// Convert the image to grayscale
-			cv::cvtColor(imgOriginal, img_gray, CV_BGR2GRAY);
-			cv::cvtColor(img_gray, img_final, CV_GRAY2BGR);
-			last_mode = GRAY;
+		pool.wait(frame);
+		if (!running)
 			break;
-		case BW:
-			cv::cvtColor(imgOriginal, img_gray, CV_RGB2GRAY);
-			img_final = img_gray > 128;
-			last_mode = BW;
-			break;
-		case SEPIA:
-			transform(imgOriginal, img_final, kern);
-			last_mode = SEPIA;
-			break;
-		case HUE:
-			cv::cvtColor(imgOriginal, imgHSV, CV_RGB2HSV);
-			split(imgHSV, hsv_planes);
-			hsv_planes[0] += hueUpdate; // H channel
-			if (!bounce)
-				hueUpdate += 10;
-			else
-				hueUpdate -= 10;
-			if (hueUpdate == 180)
-				bounce = true;
-			if (hueUpdate == 0)
-				bounce = false;
-			merge(hsv_planes, imgOriginal);
-			img_final = imgOriginal;
-			last_mode = HUE;
-			break;
-		//More filters go here.
-		case COLOR_PICK:
-			img_final = calcColorPick(imgOriginal);
-			last_mode = COLOR_PICK;
-			break;
-		case FACE:
-			img_final = calcFace(imgOriginal, haar_cascade, im_width, im_height, model);
-			last_mode = FACE;
-			break;
-		case FACE_DETECT:
-			img_final = calcFaceDetect(imgOriginal, haar_cascade, im_width, im_height, model);
-			break;
-		case MODE_ERROR:
-		default:
-			cout << "default break ERROR" << endl;
-			exit(1);
-			break;
-		}
-		
-		cv::imshow("Final", img_final); //show the chosen image
+
+		for (int i = 0; i < streams.size(); i++)
+			cv::imshow(streams[i]->window, streams[i]->img_final); //show the chosen image
 		buffer = ""; //reset buffer to get new input from Pebble
 
-		if (waitKey(30) == 27) //wait for 'esc' key press for 30ms. If 'esc' key is pressed, break loop
+		// Allow the user to click on Hue chart to change the hue, or click on the color wheel to see a value.
+		cvSetMouseCallback(colorWheelTitle, &mouseEvent, 0);
+
+		Stream &wheel = *streams[selected];
+		displayColorWheelHSV(wheel.hue, wheel.saturation, wheel.brightness, colorWheelTitle);
+
+		// Handle window events only for the time left until the next frame is due.
+		if (waitKey(pacer->waitTime()) == 27) //If 'esc' key is pressed, break loop
 		{
-			std::cout << "esc key is pressed by user" << endl;
+			LOG_INFO("esc key is pressed by user");
 			break;
 		}
-        
-		// Allow the user to click on Hue chart to change the hue, or click on the color wheel to see a value.
-		cvSetMouseCallback(colorWheelTitle, &mouseEvent, 0);
-        
-		displayColorWheelHSV(hue, saturation, brightness, colorWheelTitle);
 	}
+	for (int i = 0; i < streams.size(); i++)
+		delete streams[i];
+	delete pacer;
+	delete faceModel; // waits for a running enrollment to finish
 	return 0;
 }
 
+bool anyStreamIn(int mode)
+{
+	for (int i = 0; i < streams.size(); i++)
+	{
+		if (streams[i]->mode == mode)
+			return true;
+	}
+	return false;
+}
+
+// Runs on the thread pool, only touches the stream's own matrices.
+void processFrame(Stream &stream, int im_width, int im_height)
+{
+	Mat &img_final = stream.img_final;
+	stream.frame.reset(stream.imgOriginal);
+	switch (stream.mode)
+	{
+	case ORIGINAL:
+		img_final = stream.frame.image();
+		stream.last_mode = ORIGINAL;
+		break;
+	case OUTLINE:
+		img_final = filtered(stream, calcOutline);
+		stream.last_mode = OUTLINE;
+		break;
+	case GRAY:
+		img_final = filtered(stream, calcGray, true);
+		stream.last_mode = GRAY;
+		break;
+	case BW:
+		img_final = filtered(stream, calcBW, true);
+		stream.last_mode = BW;
+		break;
+	case SEPIA:
+		img_final = filtered(stream, calcSepia);
+		stream.last_mode = SEPIA;
+		break;
+	case HUE:
+		img_final = filtered(stream, calcHue);
+		// Once per frame, even if the filter ran on the fovea and the periphery.
+		if (!stream.bounce)
+			stream.hueUpdate += 10;
+		else
+			stream.hueUpdate -= 10;
+		if (stream.hueUpdate == 180)
+			stream.bounce = true;
+		if (stream.hueUpdate == 0)
+			stream.bounce = false;
+		stream.last_mode = HUE;
+		break;
+	//More filters go here.
+	case COLOR_PICK:
+		img_final = filtered(stream, calcColorPick);
+		stream.last_mode = COLOR_PICK;
+		break;
+	case FACE:
+		img_final = calcFace(stream, stream.frame, im_width, im_height, faceModel->get());
+		stream.last_mode = FACE;
+		break;
+	case FACE_DETECT:
+		img_final = calcFaceDetect(stream, stream.frame);
+		break;
+	case MODE_ERROR:
+	default:
+		LOG_ERROR("default break ERROR");
+		exit(1);
+		break;
+	}
+	// Both only copy the frame, encoding happens on their own threads.
+	stream.recorder.push(img_final);
+	stream.server.publish(img_final);
+	// Derived images are only good for this frame.
+	stream.frame.retire();
+}
+
+Mat filtered(Stream &stream, Mat (*filter)(Stream &, FrameCache &), bool luma)
+{
+	if (!stream.fovea.enabled())
+		return filter(stream, stream.frame);
+	// The filter runs twice, on the scaled down frame and on the fovea.
+	return stream.fovea.apply(stream.frame, [&](FrameCache &part) { return filter(stream, part); }, luma);
+}
+
+void detectFaces(Stream &stream, vector<Rect> &faces)
+{
+	if (!stream.fovea.enabled())
+	{
+		stream.haar_cascade.detectMultiScale(stream.frame.gray(), faces);
+		return;
+	}
+	// Boxes are found on the whole frame at reduced resolution, and in the fovea at full.
+	stream.fovea.detect(stream.frame, [&](const Mat &img, vector<Rect> &found) {
+		stream.haar_cascade.detectMultiScale(img, found);
+	}, faces);
+}
+
 // Used for creating the red oulines.
 void trackFilteredObject(Mat threshold, Mat &cameraFeed)
 {
@@ -363,6 +586,8 @@ void trackFilteredObject(Mat threshold, Mat &cameraFeed)
 // Used to get the HSV values when the mouse is moved.
 void mouseEvent(int ievent, int x, int y, int flags, void* param)
 {
+	// The color wheel belongs to the selected stream.
+	Stream &stream = *streams[selected];
 	// Check if they clicked or dragged a mouse button or not.
 	if (flags & CV_EVENT_FLAG_LBUTTON) {
 		mouseX = x;
@@ -372,22 +597,23 @@ void mouseEvent(int ievent, int x, int y, int flags, void* param)
 		// If they clicked on the Hue chart, select the new hue.
 		if (mouseY < HUE_HEIGHT) {
 			if (mouseX / 2 < HUE_RANGE) {	// Make sure its a valid Hue
-				hue = mouseX / 2;
+				stream.hue = mouseX / 2;
 			}
 		}
 		// If they clicked on the Color wheel, select the new value.
 		else if (mouseY >= WHEEL_TOP && mouseY <= WHEEL_BOTTOM) {
 			if (mouseX < 256) {	// Make sure its a valid Saturation & Value
-				saturation = mouseX;
-				brightness = 255 - (mouseY - WHEEL_TOP);
+				stream.saturation = mouseX;
+				stream.brightness = 255 - (mouseY - WHEEL_TOP);
 			}
 		}
 	}
 }
 
-Mat calcColorPick(Mat imgOriginal)
+Mat calcColorPick(Stream &stream, FrameCache &frame)
 {
-	float hsv[3] = { hue / 179.0f, saturation / 255.0f, brightness / 255.0f };
+	const Mat &imgOriginal = frame.image();
+	float hsv[3] = { stream.hue / 179.0f, stream.saturation / 255.0f, stream.brightness / 255.0f };
 
 	float hLow = hsv[0] - 0.10f;
 	if (hLow < 0) {
@@ -425,55 +651,73 @@ Mat calcColorPick(Mat imgOriginal)
 	int iLowV = int(ranges[2] * 255);
 	int iHighV = int(ranges[5] * 255);
 
-	//Create grayscale image
-	cvtColor(imgOriginal, img_gray, CV_RGB2GRAY);
-
-	//Convert the captured frame from BGR to HSV
-	cvtColor(imgOriginal, imgHSV, COLOR_BGR2HSV);
-
-	//Threshold the image
-	inRange(imgHSV, Scalar(iLowH, iLowS, iLowV), Scalar(iHighH, iHighS, iHighV), imgThresholded);
+	//Threshold the image (HSV of the captured frame)
+	inRange(frame.hsv(), Scalar(iLowH, iLowS, iLowV), Scalar(iHighH, iHighS, iHighV), stream.imgThresholded);
 
 	//morphological opening (removes small objects from the foreground)
-	erode(imgThresholded, imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
-	dilate(imgThresholded, imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
+	erode(stream.imgThresholded, stream.imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
+	dilate(stream.imgThresholded, stream.imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
 
 	//morphological closing (removes small holes from the foreground)
-	dilate(imgThresholded, imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
-	erode(imgThresholded, imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
+	dilate(stream.imgThresholded, stream.imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
+	erode(stream.imgThresholded, stream.imgThresholded, getStructuringElement(MORPH_ELLIPSE, Size(10, 10)));
 
 	//Creating final filtered image
-	bitwise_not(imgThresholded, img_invertThreshold);
-	cvtColor(img_invertThreshold, img_invertThreshold, CV_GRAY2RGB);
-	img_gray = img_gray - imgThresholded;
-	cvtColor(img_gray, img_grayRGB, CV_GRAY2RGB);
-	img_obj = imgOriginal - img_invertThreshold;
-	Mat img_temp = img_grayRGB + img_obj;
+	bitwise_not(stream.imgThresholded, stream.img_invertThreshold);
+	cvtColor(stream.img_invertThreshold, stream.img_invertThreshold, CV_GRAY2RGB);
+	subtract(frame.gray(), stream.imgThresholded, stream.img_gray);
+	cvtColor(stream.img_gray, stream.img_grayRGB, CV_GRAY2RGB);
+	stream.img_obj = imgOriginal - stream.img_invertThreshold;
+	Mat img_temp = stream.img_grayRGB + stream.img_obj;
 
 	//Add indicator lines.
-	trackFilteredObject(imgThresholded, img_temp);
+	trackFilteredObject(stream.imgThresholded, img_temp);
 	return img_temp;
 }
 
-Mat calcOutline(Mat imgOriginal)
+Mat calcOutline(Stream &stream, FrameCache &frame)
 {
+	const Mat &imgOriginal = frame.image();
 	// Create a matrix of the same type and size as src (for dst)
-	dst.create(imgOriginal.size(), imgOriginal.type());
+	stream.dst.create(imgOriginal.size(), imgOriginal.type());
 
-	// Convert the image to grayscale
-	cvtColor(imgOriginal, img_gray, CV_BGR2GRAY);
-
-	// Reduce noise with a kernel 3x3
-	blur(img_gray, detected_edges, Size(3, 3));
+	// Reduce noise of the grayscale image with a kernel 3x3
+	blur(frame.gray(), stream.detected_edges, Size(3, 3));
 
 	// Canny detector
-	Canny(detected_edges, detected_edges, lowThreshold, lowThreshold*ratio, kernel_size);
+	Canny(stream.detected_edges, stream.detected_edges, lowThreshold, lowThreshold*cannyRatio, kernel_size);
 
 	// Using Canny's output as a mask, we display our result
-	dst = Scalar::all(0);
+	stream.dst = Scalar::all(0);
+
+	imgOriginal.copyTo(stream.dst, stream.detected_edges);
+	return stream.dst;
+}
+
+Mat calcGray(Stream &stream, FrameCache &frame)
+{
+	cv::cvtColor(frame.gray(), stream.dst, CV_GRAY2BGR);
+	return stream.dst;
+}
+
+Mat calcBW(Stream &stream, FrameCache &frame)
+{
+	return frame.gray() > 128;
+}
+
+Mat calcSepia(Stream &stream, FrameCache &frame)
+{
+	transform(frame.image(), stream.dst, kern);
+	return stream.dst;
+}
 
-	imgOriginal.copyTo(dst, detected_edges);
-	return dst;
+Mat calcHue(Stream &stream, FrameCache &frame)
+{
+	split(frame.hsv(), stream.hsv_planes);
+	stream.hsv_planes[0] += stream.hueUpdate; // H channel
+	// The HSV planes are shown as if they were BGR.
+	merge(stream.hsv_planes, stream.dst);
+	return stream.dst;
 }
 
 static void read_csv(const string& filename, vector<Mat>& images, vector<int>& labels, char separator) {
@@ -494,69 +738,49 @@ static void read_csv(const string& filename, vector<Mat>& images, vector<int>& l
 	}
 }
 
-Mat calcFace(Mat imgOriginal, CascadeClassifier haar_cascade, int im_width, int im_height, Ptr<FaceRecognizer> model)
+Mat calcFace(Stream &stream, FrameCache &frame, int im_width, int im_height, const Ptr<FaceRecognizer> &model)
 {
-	// Convert the current frame to grayscale:
-	cvtColor(imgOriginal, img_gray, CV_BGR2GRAY);
-	// Find the faces in the frame:
-	vector< Rect_<int> > faces;
-	haar_cascade.detectMultiScale(img_gray, faces);
-	// At this point you have the position of the faces in
-	// faces. Now we'll get the faces, make a prediction and
-	// annotate it in the video. Cool or what?
-	for (int i = 0; i < faces.size(); i++) {
-		// Process face by face:
-		Rect face_i = faces[i];
-		// Crop the face from the image. So simple with OpenCV C++:
-		Mat face = img_gray(face_i);
-		// Resizing the face is necessary for Eigenfaces and Fisherfaces. You can easily
-		// verify this, by reading through the face recognition tutorial coming with OpenCV.
-		// Resizing IS NOT NEEDED for Local Binary Patterns Histograms, so preparing the
-		// input data really depends on the algorithm used.
-		//
-		// I strongly encourage you to play around with the algorithms. See which work best
-		// in your scenario, LBPH should always be a contender for robust face recognition.
-		//
-		// Since I am showing the Fisherfaces algorithm here, I also show how to resize the
-		// face you have just found:
-		Mat face_resized;
-		cv::resize(face, face_resized, Size(im_width, im_height), 1.0, 1.0, INTER_CUBIC);
-		// Now perform the prediction, see how easy that is:
-		double predict_confidence = 0.0;
-		int prediction = -1;
-		model->predict(face_resized, prediction, predict_confidence);
-		string name;
+	// Boxes are drawn on the stream's own copy of the frame, the cache's images are
+	// shared with the other filters (see FrameCache.h):
+	frame.image().copyTo(stream.dst);
+	Mat imgOriginal = stream.dst;
+	// With face workers running, the boxes are their newest ones, maybe a frame or two
+	// old but never waited for. Enrolling needs this frame's faces, so it's done here.
+	if (faceModel->isEnrolling(&stream) || !workerFaces(stream, frame)) {
+		// Find the faces in the frame:
+		vector< Rect_<int> > faces;
+		detectFaces(stream, faces);
+		// At this point you have the position of the faces in
+		// faces. Now we'll get the faces and make a prediction for all of
+		// them at once. Resizing the face is necessary for Eigenfaces and
+		// Fisherfaces, recognizeFaces() does that too.
+		Size face_size(im_width, im_height);
+		recognizeFaces(frame.gray(), faces, face_size, model, stream.face_batch, stream.face_results);
+		// While enrolling, only the largest face in view is sampled.
+		if (faceModel->isEnrolling(&stream) && !faces.empty()) {
+			int largest = 0;
+			for (int i = 1; i < faces.size(); i++) {
+				if (faces[i].area() > faces[largest].area())
+					largest = i;
+			}
+			faceModel->addSample(batchFace(stream.face_batch, largest, face_size), &stream);
+		}
+	}
+	// And finally write all we've found out to the original image!
+	for (int i = 0; i < stream.face_results.size(); i++) {
+		const FaceResult &result = stream.face_results[i];
 		string box_text;
-
-		//cout << prediction << endl;
-		//cout << predict_confidence << endl;
-
 		// Calculate the position for annotated text (make sure we don't
 		// put illegal values in there):
-		int pos_x = face_i.tl().x - 10;
-		int pos_y = face_i.tl().y - 10;
+		int pos_x = result.box.tl().x - 10;
+		int pos_y = result.box.tl().y - 10;
 
-		// And finally write all we've found out to the original image!
 		// First of all draw a green rectangle around the detected face:
-		rectangle(imgOriginal, face_i, CV_RGB(0, 255, 0), 1);
+		rectangle(imgOriginal, result.box, CV_RGB(0, 255, 0), 1);
 
-		if (predict_confidence > 0) {
-			if (prediction == 0) {
-				name = "Yuki";
-			}
-			else if (prediction == 1) {
-				name = "Alvin";
-			}
-			else if (prediction == 2) {
-				name = "Ethan";
-			}
-			else if (prediction == 3) {
-				name = "Mike";
-			} else {
-				name = "NOT RECOGNIZED";
-			}
+		if (result.confidence > 0) {
 			// Create the text we will annotate the box with:
-			box_text = "Prediction: " + name;
+			box_text = "Prediction: " + faceModel->name(result.label);
 		}
 		else {
 			box_text = "???";
@@ -567,13 +791,41 @@ Mat calcFace(Mat imgOriginal, CascadeClassifier haar_cascade, int im_width, int
 	return imgOriginal;
 }
 
-Mat calcFaceDetect(Mat imgOriginal, CascadeClassifier haar_cascade, int im_width, int im_height, Ptr<FaceRecognizer> model)
+bool workerFaces(Stream &stream, FrameCache &frame)
+{
+	if (stream.busName.empty())
+		return false;
+	const Mat &gray = frame.gray();
+	if (!stream.bus) {
+		stream.bus = FrameBus::create(stream.busName, gray.size(), gray.type());
+		if (!stream.bus) {
+			stream.busName.clear(); // recognized here from now on
+			return false;
+		}
+	}
+	stream.bus->publish(gray, ++stream.frameNumber);
+	BusResult result;
+	if (!stream.bus->latest(result, FACE_WORKER_MAX_AGE_MS))
+		return false;
+	stream.face_results.resize(result.count);
+	for (int i = 0; i < result.count; i++) {
+		const BusFace &face = result.faces[i];
+		stream.face_results[i].box = Rect(face.x, face.y, face.width, face.height);
+		stream.face_results[i].label = face.label;
+		stream.face_results[i].confidence = face.confidence;
+	}
+	return true;
+}
+
+Mat calcFaceDetect(Stream &stream, FrameCache &frame)
 {
-	// Convert the current frame to grayscale:
-	cvtColor(imgOriginal, img_gray, CV_BGR2GRAY);
+	// Boxes are drawn on the stream's own copy of the frame, the cache's images are
+	// shared with the other filters (see FrameCache.h):
+	frame.image().copyTo(stream.dst);
+	Mat imgOriginal = stream.dst;
 	// Find the faces in the frame:
 	vector< Rect_<int> > faces;
-	haar_cascade.detectMultiScale(img_gray, faces);
+	detectFaces(stream, faces);
 	// At this point you have the position of the faces in
 	// faces. Now we'll get the faces, make a prediction and
 	// annotate it in the video. Cool or what?
@@ -745,68 +997,91 @@ size_t curl_write(void *ptr, size_t size, size_t nmemb, void *stream)
 	return size*nmemb;
 }
 
-int getMode(std::string buf)
+int getMode(Stream &stream, std::string buf)
 {
-	std::cout << buf << endl;
+	LOG_DEBUG("command: {}", buf);
 	if (!buf.compare("null") || buf == "")
-		return mode;
+		return stream.mode;
 	if (!buf.compare("original"))
-		mode = ORIGINAL;
+		stream.mode = ORIGINAL;
 	else if (!buf.compare("outline"))
-		mode = OUTLINE;
+		stream.mode = OUTLINE;
 	else if (!buf.compare("grayscale"))
-		mode = GRAY;
+		stream.mode = GRAY;
 	else if (buf == "b/w")
-		mode = BW;
+		stream.mode = BW;
 	else if (buf == "sepia")
-		mode = SEPIA;
+		stream.mode = SEPIA;
 	else if (buf == "hue scan")
-		mode = HUE;
+		stream.mode = HUE;
 	else if (buf == "face scan")
-		mode = FACE;
+		stream.mode = FACE;
 	else if (buf == "face detect")
-		mode = FACE_DETECT;
+		stream.mode = FACE_DETECT;
+	else if (!buf.compare(0, 7, "enroll:"))
+	{
+		// Capture faces for a new person, face scan has to run to see them. Faces are
+		// only taken from the stream named with "cam N:enroll:", or the first one when
+		// the command reaches every stream, as only the first one starts it.
+		if (!faceModel->isEnrolling() && !faceModel->startEnroll(buf.substr(7), &stream))
+			LOG_WARN("Cannot enroll, enrollment already in progress");
+		stream.mode = FACE;
+	}
+	else if (!buf.compare(0, 6, "record"))
+		recordCommand(stream, buf); // doesn't change the mode
+	else if (!buf.compare(0, 5, "mjpeg"))
+		mjpegCommand(stream, buf); // doesn't change the mode
+	else if (!buf.compare(0, 5, "fovea"))
+		foveaCommand(stream, buf); // doesn't change the mode
+	else if (!buf.compare(0, 5, "pace:"))
+	{
+		// Display refresh rate to pace to, 0 goes back to the camera's rate. Given as a
+		// starting mode it's kept until the pacer is created.
+		pace_fps = atof(buf.substr(5).c_str());
+		if (pacer)
+			pacer->setRate(pace_fps > 0 ? pace_fps : streams[0]->fps);
+	}
 	else if (buf.size() > 0)
 	{
-		mode = COLOR_PICK;
+		stream.mode = COLOR_PICK;
 		char first = buf[0];
 		if (first == '+' || first == '-')
 		{
 			if (buf == "+ hue")
 			{
-				hue += 12;
-				if (hue > 179)
-					hue = 179;
+				stream.hue += 12;
+				if (stream.hue > 179)
+					stream.hue = 179;
 			}
 			else if (buf == "+ saturation")
 			{
-				saturation += 16;
-				if (saturation > 255)
-					saturation = 255;
+				stream.saturation += 16;
+				if (stream.saturation > 255)
+					stream.saturation = 255;
 			}
 			else if (buf == "+ lightness")
 			{
-				brightness += 16;
-				if (brightness > 255)
-					brightness = 255;
+				stream.brightness += 16;
+				if (stream.brightness > 255)
+					stream.brightness = 255;
 			}
 			else if (buf == "- hue")
 			{
-				hue -= 12;
-				if (hue < 0)
-					hue = 0;
+				stream.hue -= 12;
+				if (stream.hue < 0)
+					stream.hue = 0;
 			}
 			else if (buf == "- saturation")
 			{
-				saturation -= 16;
-				if (saturation < 0)
-					saturation = 0;
+				stream.saturation -= 16;
+				if (stream.saturation < 0)
+					stream.saturation = 0;
 			}
 			else if (buf == "- lightness")
 			{
-				brightness -= 16;
-				if (brightness < 0)
-					brightness = 0;
+				stream.brightness -= 16;
+				if (stream.brightness < 0)
+					stream.brightness = 0;
 			}
 		}
 		else
@@ -834,11 +1109,10 @@ int getMode(std::string buf)
 					v += buf[i];
 				}
 			}
-			hue = (((double)(atoi(h.c_str())+1.0)/360.0)*180.0);
-			saturation = ((double)(atoi(s.c_str())/100.0)*255.0);
-			brightness = ((double)(atoi(v.c_str())/100.0)*255.0);
-			cout << "h: " << h << " s: " << s << " v: " << v;
-			cout << "hue: " << hue << " sat: " << saturation << " val: " << brightness;
+			stream.hue = (((double)(atoi(h.c_str())+1.0)/360.0)*180.0);
+			stream.saturation = ((double)(atoi(s.c_str())/100.0)*255.0);
+			stream.brightness = ((double)(atoi(v.c_str())/100.0)*255.0);
+			LOG_INFO("h: {} s: {} v: {} hue: {} sat: {} val: {}", h, s, v, stream.hue, stream.saturation, stream.brightness);
 			h = "";
 			s = "";
 			v = "";
@@ -848,7 +1122,103 @@ int getMode(std::string buf)
 		}
 	}
 	else
-		mode = last_mode;
-	std::cout << mode;
-	return mode;
-}
\ No newline at end of file
+		stream.mode = stream.last_mode;
+	LOG_DEBUG("mode: {}", stream.mode);
+	return stream.mode;
+}
+
+void handleCommand(std::string buf)
+{
+	// "cam N:command" only goes to stream N, anything else goes to every stream.
+	if (!buf.compare(0, 4, "cam "))
+	{
+		size_t colon = buf.find(':');
+		int index = atoi(buf.substr(4, colon - 4).c_str());
+		if (colon == string::npos || index < 0 || index >= streams.size())
+		{
+			LOG_WARN("No such stream: {}", buf);
+			return;
+		}
+		selected = index;
+		getMode(*streams[index], buf.substr(colon + 1));
+		return;
+	}
+	for (int i = 0; i < streams.size(); i++)
+		getMode(*streams[i], buf);
+}
+
+void recordCommand(Stream &stream, std::string buf)
+{
+	if (buf == "record on")
+	{
+		// One file per camera and start time, e.g. findAR_0_1413757200.avi
+		stringstream file;
+		file << "findAR_" << stream.device << "_" << time(0) << ".avi";
+		double fps = stream.fps;
+		if (fps <= 0)
+			fps = 30;
+		stream.recorder.start(file.str(), record_codec, fps, stream.imgOriginal.size());
+	}
+	else if (buf == "record off")
+		stream.recorder.stop();
+	else if (!buf.compare(0, 13, "record codec:"))
+	{
+		record_codec = buf.substr(13);
+		// Commands arrive lower case, codecs are upper case.
+		for (int i = 0; i < record_codec.size(); i++)
+			record_codec[i] = toupper(record_codec[i]);
+	}
+	else if (buf == "record drop")
+		stream.recorder.setPolicy(RECORD_DROP, 0);
+	else if (!buf.compare(0, 13, "record every:"))
+		stream.recorder.setPolicy(RECORD_EVERY_NTH, atoi(buf.substr(13).c_str()));
+	else
+		LOG_WARN("Unknown record command: {}", buf);
+}
+
+void mjpegCommand(Stream &stream, std::string buf)
+{
+	if (!buf.compare(0, 14, "mjpeg quality:"))
+		stream.server.setQuality(atoi(buf.substr(14).c_str()));
+	else if (!buf.compare(0, 12, "mjpeg scale:"))
+		stream.server.setScale(atof(buf.substr(12).c_str()));
+	else
+		LOG_WARN("Unknown mjpeg command: {}", buf);
+}
+
+void foveaCommand(Stream &stream, std::string buf)
+{
+	Foveator &fovea = stream.fovea;
+	if (buf == "fovea on")
+		fovea.setEnabled(true);
+	else if (buf == "fovea off")
+		fovea.setEnabled(false);
+	else if (!buf.compare(0, 13, "fovea center:"))
+	{
+		// "fovea center:X,Y" as fractions of the frame, 0.5,0.5 is the middle.
+		size_t comma = buf.find(',', 13);
+		if (comma == string::npos)
+		{
+			LOG_WARN("Expected fovea center:X,Y, got: {}", buf);
+			return;
+		}
+		fovea.setCenter(atof(buf.substr(13, comma - 13).c_str()), atof(buf.substr(comma + 1).c_str()));
+	}
+	// Small steps for the Pebble's buttons.
+	else if (buf == "fovea left")
+		fovea.setCenter(fovea.centerX() - 0.05, fovea.centerY());
+	else if (buf == "fovea right")
+		fovea.setCenter(fovea.centerX() + 0.05, fovea.centerY());
+	else if (buf == "fovea up")
+		fovea.setCenter(fovea.centerX(), fovea.centerY() - 0.05);
+	else if (buf == "fovea down")
+		fovea.setCenter(fovea.centerX(), fovea.centerY() + 0.05);
+	else if (!buf.compare(0, 11, "fovea size:"))
+		fovea.setSize(atof(buf.substr(11).c_str()));
+	else if (!buf.compare(0, 12, "fovea scale:"))
+		fovea.setScale(atof(buf.substr(12).c_str()));
+	else if (!buf.compare(0, 14, "fovea feather:"))
+		fovea.setFeather(atof(buf.substr(14).c_str()));
+	else
+		LOG_WARN("Unknown fovea command: {}", buf);
+}